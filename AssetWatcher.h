@@ -0,0 +1,242 @@
+/*AssetWatcher.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Watches asset files for changes while the game runs, so edited images can be reloaded without a restart.
+* A background thread waits for the operating system to report changes (inotify) in the directories
+* holding the watched files; on other systems it checks the files' modification times a few times a
+* second instead. Changed files pile up until collected on the game thread.
+*
+* Both saving in place and the save-to-a-temp-file-then-rename trick most editors use are caught.
+*/
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <sys/stat.h>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#define ASSETWATCHER_INOTIFY
+#endif
+
+#ifndef ASSETWATCHER_H
+#define ASSETWATCHER_H
+
+#define WATCH_POLL_INTERVAL 250 // ms between checks when there are no change notifications
+#define WATCH_WAKE_INTERVAL 100 // ms the thread waits for notifications before checking if it should quit
+
+//------------------------------- CLASS: ASSET WATCHER ----------------------------------
+class AssetWatcher
+{
+
+public:
+	AssetWatcher()
+	{
+		thread = NULL;
+		quit = false;
+		lock = SDL_CreateMutex();
+
+#ifdef ASSETWATCHER_INOTIFY
+		fd = inotify_init();
+#endif
+	}
+
+	virtual ~AssetWatcher()
+	{
+		if(thread != NULL)
+		{
+			quit = true;
+			SDL_WaitThread(thread, NULL);
+		}
+
+#ifdef ASSETWATCHER_INOTIFY
+		if(fd >= 0)
+			close(fd);
+#endif
+
+		SDL_DestroyMutex(lock);
+	}
+
+	// true if changes are reported by the system rather than found by checking every file
+	bool isNotified()
+	{
+#ifdef ASSETWATCHER_INOTIFY
+		return fd >= 0;
+#else
+		return false;
+#endif
+	}
+
+	// starts watching a file (named the same way it's loaded, e.g "images/smiley.png")
+	void watch(std::string file)
+	{
+		SDL_mutexP(lock);
+
+		if(files.insert(file).second)
+		{
+			if(isNotified())
+				watchDir(dirOf(file));
+			else
+				mtimes[file] = modifiedTime(file);
+		}
+
+		SDL_mutexV(lock);
+
+		if(thread == NULL)
+			thread = SDL_CreateThread(watchThread, this);
+	}
+
+	// hands over every watched file that has changed since the last call (each only once)
+	void collect(std::vector<std::string>* out)
+	{
+		SDL_mutexP(lock);
+		out->insert(out->end(), changed.begin(), changed.end());
+		changed.clear();
+		SDL_mutexV(lock);
+	}
+
+	static time_t modifiedTime(std::string file)
+	{
+		struct stat info;
+		if(stat(file.c_str(), &info) != 0)
+			return 0;
+
+		return info.st_mtime;
+	}
+
+protected:
+	SDL_Thread* thread;
+	SDL_mutex* lock; // guards everything below
+	std::atomic<bool> quit;
+
+	std::set<std::string> files; // everything being watched
+	std::set<std::string> changed; // waiting to be collected
+	std::map<std::string,time_t> mtimes; // last seen modification times, when checking by hand
+
+#ifdef ASSETWATCHER_INOTIFY
+	int fd; // inotify instance, -1 if it couldn't be made
+	std::map<int,std::string> dirs; // watch descriptor -> directory (as it appears in file names)
+	std::set<std::string> watchedDirs;
+#endif
+
+	static int watchThread(void* data)
+	{
+		AssetWatcher* w = (AssetWatcher*)data;
+
+#ifdef ASSETWATCHER_INOTIFY
+		if(w->fd >= 0)
+		{
+			w->waitForNotifications();
+			return 0;
+		}
+#endif
+
+		w->pollFiles();
+		return 0;
+	}
+
+	// "images/a.png" -> "images", "a.png" -> ""
+	static std::string dirOf(std::string file)
+	{
+		size_t slash = file.find_last_of("/\\");
+		if(slash == std::string::npos)
+			return "";
+
+		return file.substr(0, slash);
+	}
+
+	// asks for notifications about the directory, if they aren't coming already; lock must be held
+	void watchDir(std::string dir)
+	{
+#ifdef ASSETWATCHER_INOTIFY
+		if(watchedDirs.find(dir) != watchedDirs.end())
+			return;
+
+		int wd = inotify_add_watch(fd, dir.empty() ? "." : dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if(wd >= 0)
+		{
+			watchedDirs.insert(dir);
+			dirs[wd] = dir;
+		}
+#endif
+	}
+
+	void pollFiles()
+	{
+		while(!quit)
+		{
+			for(int waited = 0; waited < WATCH_POLL_INTERVAL && !quit; waited += WATCH_WAKE_INTERVAL)
+				SDL_Delay(WATCH_WAKE_INTERVAL);
+
+			SDL_mutexP(lock);
+			std::vector<std::string> check(files.begin(), files.end());
+			SDL_mutexV(lock);
+
+			for(unsigned int i = 0; i < check.size(); i++)
+			{
+				time_t t = modifiedTime(check[i]); // no lock held while touching the disk
+
+				SDL_mutexP(lock);
+				if(t != 0 && t != mtimes[check[i]])
+				{
+					mtimes[check[i]] = t;
+					changed.insert(check[i]);
+				}
+				SDL_mutexV(lock);
+			}
+		}
+	}
+
+#ifdef ASSETWATCHER_INOTIFY
+	void waitForNotifications()
+	{
+		long buffer[1024]; // longs so the events in it are aligned
+
+		while(!quit)
+		{
+			pollfd p;
+			p.fd = fd;
+			p.events = POLLIN;
+			p.revents = 0;
+
+			if(poll(&p, 1, WATCH_WAKE_INTERVAL) <= 0)
+				continue;
+
+			int len = read(fd, (char*)buffer, sizeof(buffer));
+			if(len <= 0)
+				continue;
+
+			SDL_mutexP(lock);
+
+			for(int i = 0; i < len; )
+			{
+				inotify_event* e = (inotify_event*)((char*)buffer + i);
+				i += sizeof(inotify_event) + e->len;
+
+				std::map<int,std::string>::iterator d = dirs.find(e->wd);
+				if(e->len == 0 || d == dirs.end())
+					continue;
+
+				std::string file = d->second.empty() ? e->name : d->second + "/" + e->name;
+				if(files.find(file) != files.end())
+					changed.insert(file);
+			}
+
+			SDL_mutexV(lock);
+		}
+	}
+#endif
+
+};
+	// END OF: ASSET WATCHER -----------------------------------
+#endif
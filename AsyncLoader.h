@@ -0,0 +1,155 @@
+/*AsyncLoader.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Decodes image files on a background thread. Requests are queued from the game thread, a worker thread
+* does the slow part (reading and decoding the file with IMG_Load), and the decoded surfaces are picked
+* up again on the game thread with collect, where they can be converted to the display format and put to
+* use. The worker thread is only started once something is actually requested.
+*/
+
+#pragma once
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "SDL_image.h"
+
+#ifndef ASYNCLOADER_H
+#define ASYNCLOADER_H
+
+//------------------------------- CLASS: ASYNC LOADER ----------------------------------
+class AsyncLoader
+{
+
+public:
+	AsyncLoader()
+	{
+		thread = NULL;
+		quit = false;
+		lock = SDL_CreateMutex();
+		wake = SDL_CreateCond();
+	}
+
+	virtual ~AsyncLoader()
+	{
+		if(thread != NULL)
+		{
+			SDL_mutexP(lock);
+			quit = true;
+			SDL_CondSignal(wake);
+			SDL_mutexV(lock);
+
+			SDL_WaitThread(thread, NULL);
+		}
+
+		// anything decoded but never collected
+		for(unsigned int i = 0; i < done.size(); i++)
+			SDL_FreeSurface(done[i].second);
+
+		SDL_DestroyCond(wake);
+		SDL_DestroyMutex(lock);
+	}
+
+	// queues a file to be decoded, unless it's already queued or being decoded
+	void request(std::string file)
+	{
+		SDL_mutexP(lock);
+
+		if(pending.find(file) == pending.end())
+		{
+			pending.insert(file);
+			todo.push_back(file);
+			SDL_CondSignal(wake);
+		}
+
+		SDL_mutexV(lock);
+
+		if(thread == NULL)
+			thread = SDL_CreateThread(workerThread, this);
+	}
+
+	// true if the file has been requested and hasn't been collected yet
+	bool isPending(std::string file)
+	{
+		SDL_mutexP(lock);
+		bool p = pending.find(file) != pending.end();
+		SDL_mutexV(lock);
+
+		return p;
+	}
+
+	int getNumPending()
+	{
+		SDL_mutexP(lock);
+		int n = pending.size();
+		SDL_mutexV(lock);
+
+		return n;
+	}
+
+	// hands over every finished file as (file name, decoded surface); the surface is NULL if the file
+	// couldn't be loaded. The caller owns the surfaces
+	void collect(std::vector< std::pair<std::string,SDL_Surface*> >* out)
+	{
+		SDL_mutexP(lock);
+
+		for(unsigned int i = 0; i < done.size(); i++)
+		{
+			out->push_back(done[i]);
+			pending.erase(done[i].first);
+		}
+		done.clear();
+
+		SDL_mutexV(lock);
+	}
+
+protected:
+	SDL_Thread* thread;
+	SDL_mutex* lock; // guards everything below
+	SDL_cond* wake; // signalled when there is work (or when it's time to quit)
+	bool quit;
+
+	std::deque<std::string> todo; // files waiting for the worker
+	std::vector< std::pair<std::string,SDL_Surface*> > done; // decoded, waiting to be collected
+	std::set<std::string> pending; // everything requested and not yet collected
+
+	static int workerThread(void* data)
+	{
+		AsyncLoader* l = (AsyncLoader*)data;
+		l->work();
+		return 0;
+	}
+
+	void work()
+	{
+		SDL_mutexP(lock);
+
+		while(true)
+		{
+			while(todo.empty() && !quit)
+				SDL_CondWait(wake, lock);
+			if(quit)
+				break;
+
+			std::string file = todo.front();
+			todo.pop_front();
+
+			SDL_mutexV(lock); // decode without holding the lock
+			SDL_Surface* img = IMG_Load(file.c_str());
+			SDL_mutexP(lock);
+
+			done.push_back(std::pair<std::string,SDL_Surface*>(file, img));
+		}
+
+		SDL_mutexV(lock);
+	}
+
+};
+	// END OF: ASYNC LOADER -----------------------------------
+#endif
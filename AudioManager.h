@@ -0,0 +1,528 @@
+/*AudioManager.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Plays sound effects (and music, as a looping sound). Sounds are loaded up front from a text file, the
+* same way SpriteManager loads images, and converted once to the format the mixer works in (16 bit
+* stereo at the output rate), so playing one never does any converting or allocating.
+*
+* Any number of sounds (up to MAX_VOICES) can play at once, each with its own volume and pan. The voices
+* are mixed in SDL's audio callback, 8 samples at a time with SSE2 saturating adds where available (plain
+* C++ otherwise). Game code never touches the voices directly: play, stop and so on push a command onto a
+* lock free queue that the audio callback empties before each mix, so the game thread never waits on the
+* audio thread. The queue has one writer and one reader, so those calls belong to the game thread only.
+*
+* Without a sound device (or if open wasn't called) the manager runs headless: nothing is played, but
+* mix can still be called directly to fill a buffer, e.g. to measure how long mixing takes.
+*
+* Format of the sound list: one WAV file name per line, ending with END. Sounds are named by file name.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <atomic>
+
+#include "SDL.h"
+#include "MemoryTracker.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUDIO_SSE2
+#endif
+
+#ifndef AUDIOMANAGER_H
+#define AUDIOMANAGER_H
+
+#define MAX_VOICES 64 // sounds playing at once; plays past this are dropped
+#define AUDIO_QUEUE_SIZE 256 // commands that can wait for the audio callback (power of two)
+#define DEFAULT_AUDIO_RATE 44100
+#define DEFAULT_AUDIO_BUFFER 1024 // sample frames per callback; smaller means less delay but more callbacks
+#define AUDIO_GAIN_ONE 32767 // full volume, gains are fixed point with 15 fractional bits
+
+//--------------------- STRUCT : SAMPLE
+// a loaded sound, 16 bit stereo (left and right interleaved) at the mixer's rate
+struct Sample
+{
+	Sint16* data;
+	Uint32 frames; // number of left/right pairs
+};
+	//END OF: SAMPLE---------------------
+
+
+//------------------------------- CLASS: AUDIO MANAGER ----------------------------------
+class AudioManager
+{
+
+public:
+	bool isOpen()						{return opened;} // false when headless
+	int getRate()						{return rate;}
+	int getNumVoices()					{return activeVoices;} // playing as of the last mix
+	int getNumDroppedCommands()			{return droppedCmds;} // queue was full
+	std::map<std::string,Sample*>* getSounds()	{return &sounds;}
+
+	AudioManager()
+	{
+		opened = false;
+		rate = DEFAULT_AUDIO_RATE;
+		nextVoiceId = 0;
+		activeVoices = 0;
+		droppedCmds = 0;
+		head = 0;
+		tail = 0;
+		masterGain = AUDIO_GAIN_ONE;
+
+		for(int i = 0; i < MAX_VOICES; i++)
+			voices[i].sample = NULL;
+
+		MEM_TRACK(MEM_MANAGERS, sizeof(AudioManager));
+	}
+
+	virtual ~AudioManager()
+	{
+		close();
+		clearSounds();
+		MEM_UNTRACK(MEM_MANAGERS, sizeof(AudioManager));
+	}
+
+	// opens the sound device and starts playing; returns false (and stays headless) if it couldn't
+	// sounds are converted to the rate they're loaded at, so open before loading them
+	bool open(int freq = DEFAULT_AUDIO_RATE, int bufferFrames = DEFAULT_AUDIO_BUFFER)
+	{
+		if(opened)
+			return true;
+
+		rate = freq;
+
+		SDL_AudioSpec want;
+		want.freq = freq;
+		want.format = AUDIO_S16SYS;
+		want.channels = 2;
+		want.samples = bufferFrames;
+		want.callback = audioCallback;
+		want.userdata = this;
+
+		if(SDL_OpenAudio(&want, NULL) < 0) // NULL: SDL converts to the device's format if it has to
+			return false;
+
+		opened = true;
+		SDL_PauseAudio(0);
+
+		return true;
+	}
+
+	void close()
+	{
+		if(!opened)
+			return;
+
+		SDL_CloseAudio();
+		opened = false;
+	}
+
+	// loads every sound listed in the file (format at the top); a missing list just loads nothing
+	virtual void loadSounds(std::string fileName = "files/sounds.txt")
+	{
+		std::ifstream file(fileName.c_str());
+		std::string line;
+
+		while(getline(file,line) && line != "END")
+		{
+			if(line.empty())
+				continue;
+
+			Sample* s = loadSound(line);
+			if(s != NULL)
+				addSound(line, s);
+		}
+
+		file.close();
+	}
+
+	// adds a sound under name, replacing (and freeing) any already there; the manager owns it
+	void addSound(std::string name, Sample* s)
+	{
+		std::map<std::string,Sample*>::iterator it = sounds.find(name);
+		if(it != sounds.end())
+		{
+			Sample* old = it->second;
+			it->second = s;
+			freeSound(old);
+		}
+		else
+			sounds[name] = s;
+	}
+
+	Sample* getSound(std::string name)
+	{
+		std::map<std::string,Sample*>::iterator it = sounds.find(name);
+		if(it == sounds.end())
+			return NULL;
+
+		return it->second;
+	}
+
+	// frees every sound, stopping everything that's playing first
+	void clearSounds()
+	{
+		lockMixer();
+		drainCommands();
+		for(int i = 0; i < MAX_VOICES; i++)
+			voices[i].sample = NULL;
+		unlockMixer();
+
+		for(std::map<std::string,Sample*>::iterator it = sounds.begin(); it != sounds.end(); it++)
+			deleteSample(it->second);
+		sounds.clear();
+	}
+
+	// PLAYING
+	// starts a sound; volume goes from 0 to 1, pan from -1 (left) to 1 (right)
+	// returns a handle for stop/setVolume, or -1 if the sound doesn't exist or the queue is full
+	int play(std::string name, float volume = 1, float pan = 0, bool loop = false)
+	{
+		Sample* s = getSound(name);
+		if(s == NULL)
+			return -1;
+
+		AudioCmd c;
+		c.type = AUDIO_PLAY;
+		c.voice = nextVoiceId++;
+		c.sample = s;
+		c.loop = loop;
+		gains(volume, pan, &c.left, &c.right);
+
+		return push(c) ? c.voice : -1;
+	}
+
+	// stops a sound started by play (doing nothing if it already finished)
+	void stop(int voice)
+	{
+		AudioCmd c;
+		c.type = AUDIO_STOP;
+		c.voice = voice;
+		push(c);
+	}
+
+	void stopAll()
+	{
+		AudioCmd c;
+		c.type = AUDIO_STOP_ALL;
+		push(c);
+	}
+
+	void setVolume(int voice, float volume, float pan = 0)
+	{
+		AudioCmd c;
+		c.type = AUDIO_SET_GAIN;
+		c.voice = voice;
+		gains(volume, pan, &c.left, &c.right);
+		push(c);
+	}
+
+	// scales every sound, 0 to 1
+	void setMasterVolume(float volume)
+	{
+		AudioCmd c;
+		c.type = AUDIO_SET_MASTER;
+		c.left = c.right = toGain(volume);
+		push(c);
+	}
+
+	// MIXING
+	// carries out any waiting commands, then mixes the next frames sample frames of every playing sound
+	// into out (16 bit stereo, 2 values per frame). Called from the audio callback when open; when headless
+	// it can be called from the game thread instead
+	void mix(Sint16* out, int frames)
+	{
+		drainCommands();
+		memset(out, 0, frames * 2 * sizeof(Sint16));
+
+		int active = 0;
+		for(int i = 0; i < MAX_VOICES; i++)
+		{
+			Voice* v = &voices[i];
+			if(v->sample == NULL)
+				continue;
+
+			int left = v->left * masterGain >> 15;
+			int right = v->right * masterGain >> 15;
+			int done = 0;
+
+			while(done < frames && v->sample != NULL)
+			{
+				int n = frames - done;
+				if((Uint32)n > v->sample->frames - v->pos)
+					n = v->sample->frames - v->pos;
+
+				mixVoice(out + done * 2, v->sample->data + v->pos * 2, n, left, right);
+				done += n;
+				v->pos += n;
+
+				if(v->pos >= v->sample->frames)
+				{
+					if(v->loop && v->sample->frames > 0)
+						v->pos = 0;
+					else
+						v->sample = NULL;
+				}
+			}
+
+			if(v->sample != NULL)
+				active++;
+		}
+
+		activeVoices = active;
+	}
+
+	// adds src scaled by the left/right gains onto dst, saturating, for frames stereo frames
+	static void mixVoice(Sint16* dst, const Sint16* src, int frames, int left, int right)
+	{
+		int n = frames * 2;
+		int i = 0;
+
+#ifdef AUDIO_SSE2
+		__m128i gain = _mm_set_epi16(right, left, right, left, right, left, right, left);
+
+		for(; i + 8 <= n; i += 8)
+		{
+			__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+
+			// full 32 bit products, then back down to 16 bits
+			__m128i lo = _mm_mullo_epi16(s, gain);
+			__m128i hi = _mm_mulhi_epi16(s, gain);
+			__m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15);
+			__m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15);
+			__m128i scaled = _mm_packs_epi32(p0, p1);
+
+			__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epi16(d, scaled));
+		}
+#endif
+
+		for(; i < n; i++)
+		{
+			int g = (i & 1) ? right : left;
+			int v = dst[i] + (src[i] * g >> 15);
+			dst[i] = v > 32767 ? 32767 : (v < -32768 ? -32768 : v);
+		}
+	}
+
+	// loads a WAV file and converts it to the mixer's format, or returns NULL if it couldn't
+	Sample* loadSound(std::string file)
+	{
+		SDL_AudioSpec spec;
+		Uint8* buf;
+		Uint32 len;
+
+		if(SDL_LoadWAV(file.c_str(), &spec, &buf, &len) == NULL)
+			return NULL;
+
+		SDL_AudioCVT cvt;
+		if(SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq, AUDIO_S16SYS, 2, rate) < 0)
+		{
+			SDL_FreeWAV(buf);
+			return NULL;
+		}
+
+		cvt.len = len;
+		cvt.buf = new Uint8[len * cvt.len_mult];
+		memcpy(cvt.buf, buf, len);
+		SDL_FreeWAV(buf);
+
+		if(SDL_ConvertAudio(&cvt) < 0)
+		{
+			delete[] cvt.buf;
+			return NULL;
+		}
+
+		Sample* s = new Sample();
+		s->frames = cvt.len_cvt / 4;
+		s->data = new Sint16[s->frames * 2];
+		memcpy(s->data, cvt.buf, s->frames * 4);
+		delete[] cvt.buf;
+
+		return s;
+	}
+
+protected:
+	enum {AUDIO_PLAY, AUDIO_STOP, AUDIO_STOP_ALL, AUDIO_SET_GAIN, AUDIO_SET_MASTER};
+
+	struct AudioCmd
+	{
+		int type;
+		int voice; // handle given out by play
+		Sample* sample;
+		int left, right; // gains
+		bool loop;
+	};
+
+	// only touched by whoever is mixing
+	struct Voice
+	{
+		Sample* sample; // NULL if the voice is free
+		Uint32 pos; // next frame to mix
+		int id;
+		int left, right;
+		bool loop;
+	};
+
+	bool opened;
+	int rate;
+	std::map<std::string,Sample*> sounds;
+	Voice voices[MAX_VOICES];
+	int masterGain;
+	int nextVoiceId;
+	std::atomic<int> activeVoices;
+	int droppedCmds;
+
+	// single producer (game thread) single consumer (mixer) ring of commands
+	AudioCmd queue[AUDIO_QUEUE_SIZE];
+	std::atomic<Uint32> head; // next slot to write, only advanced by the producer
+	std::atomic<Uint32> tail; // next slot to read, only advanced by the consumer
+
+	static void audioCallback(void* data, Uint8* stream, int len)
+	{
+		AudioManager* a = (AudioManager*)data;
+		a->mix((Sint16*)stream, len / 4);
+	}
+
+	bool push(const AudioCmd& c)
+	{
+		Uint32 h = head.load(std::memory_order_relaxed);
+		if(h - tail.load(std::memory_order_acquire) >= AUDIO_QUEUE_SIZE)
+		{
+			droppedCmds++;
+			return false;
+		}
+
+		queue[h & (AUDIO_QUEUE_SIZE - 1)] = c;
+		head.store(h + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	void drainCommands()
+	{
+		Uint32 t = tail.load(std::memory_order_relaxed);
+		Uint32 h = head.load(std::memory_order_acquire);
+
+		for(; t != h; t++)
+			apply(&queue[t & (AUDIO_QUEUE_SIZE - 1)]);
+
+		tail.store(t, std::memory_order_release);
+	}
+
+	void apply(AudioCmd* c)
+	{
+		if(c->type == AUDIO_STOP_ALL)
+		{
+			for(int i = 0; i < MAX_VOICES; i++)
+				voices[i].sample = NULL;
+			return;
+		}
+
+		if(c->type == AUDIO_SET_MASTER)
+		{
+			masterGain = c->left;
+			return;
+		}
+
+		if(c->type == AUDIO_PLAY)
+		{
+			for(int i = 0; i < MAX_VOICES; i++)
+			{
+				Voice* v = &voices[i];
+				if(v->sample != NULL)
+					continue;
+
+				v->sample = c->sample;
+				v->pos = 0;
+				v->id = c->voice;
+				v->left = c->left;
+				v->right = c->right;
+				v->loop = c->loop;
+				return;
+			}
+			return; // every voice is busy
+		}
+
+		for(int i = 0; i < MAX_VOICES; i++)
+		{
+			Voice* v = &voices[i];
+			if(v->sample == NULL || v->id != c->voice)
+				continue;
+
+			if(c->type == AUDIO_STOP)
+				v->sample = NULL;
+			else if(c->type == AUDIO_SET_GAIN)
+			{
+				v->left = c->left;
+				v->right = c->right;
+			}
+			return;
+		}
+	}
+
+	// the audio callback can't run between these (no need when headless, mixing is on this thread then)
+	void lockMixer()
+	{
+		if(opened)
+			SDL_LockAudio();
+	}
+
+	void unlockMixer()
+	{
+		if(opened)
+			SDL_UnlockAudio();
+	}
+
+	// frees a sound that might be playing
+	void freeSound(Sample* s)
+	{
+		lockMixer();
+		drainCommands();
+		for(int i = 0; i < MAX_VOICES; i++)
+		{
+			if(voices[i].sample == s)
+				voices[i].sample = NULL;
+		}
+		unlockMixer();
+
+		deleteSample(s);
+	}
+
+	static void deleteSample(Sample* s)
+	{
+		delete[] s->data;
+		delete s;
+	}
+
+	static int toGain(float volume)
+	{
+		if(volume <= 0)
+			return 0;
+		if(volume >= 1)
+			return AUDIO_GAIN_ONE;
+
+		return (int)(volume * AUDIO_GAIN_ONE);
+	}
+
+	// volume and pan to left and right gains; the side panned away from gets quieter
+	static void gains(float volume, float pan, int* left, int* right)
+	{
+		if(pan < -1)
+			pan = -1;
+		if(pan > 1)
+			pan = 1;
+
+		*left = toGain(volume * (pan > 0 ? 1 - pan : 1));
+		*right = toGain(volume * (pan < 0 ? 1 + pan : 1));
+	}
+
+};
+	// END OF: AUDIO MANAGER -----------------------------------
+#endif
@@ -0,0 +1,289 @@
+/*BandRasterizer.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Draws a recorded frame (RenderSnapshot) using several threads. The screen is cut into horizontal bands,
+* and each band is drawn by a worker thread, which replays every draw call of the frame clipped to its
+* band. Calls are replayed in the order they were recorded, so the result is exactly what drawing them one
+* after the other would give; the bands just never touch each other's pixels.
+*
+* SDL_BlitSurface can't be used from several threads at once (it caches blit info on the source surface),
+* so the workers do their own blits: RLE sprites use their span blitter, and plain surfaces use a colorkey
+* row copier. That only works when the sources are in the screen's 32 bit format without per pixel alpha
+* (always true for images loaded by SpriteManager) and the screen is a software surface that needs no
+* locking; a frame containing anything else is simply drawn on the calling thread the usual way.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstring>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "RenderSnapshot.h"
+
+#ifndef BANDRASTERIZER_H
+#define BANDRASTERIZER_H
+
+#define DEFAULT_RASTER_THREADS 4
+#define BANDS_PER_THREAD 2 // more bands than threads, so a thread with light bands can pick up another
+
+//------------------------------- CLASS: BAND RASTERIZER ----------------------------------
+class BandRasterizer
+{
+
+public:
+	int getNumThreads()					{return numThreads;}
+	Uint32 getLastRenderTime()			{return lastRenderTime;} // ms the last frame took to draw
+	bool wasLastFrameBanded()			{return lastBanded;} // false if the last frame had to be drawn serially
+
+	// threads is the total number drawing, including the calling thread
+	BandRasterizer(int threads = DEFAULT_RASTER_THREADS)
+	{
+		numThreads = threads < 1 ? 1 : threads;
+		snapshot = NULL;
+		dst = NULL;
+		quit = false;
+		lastRenderTime = 0;
+		lastBanded = false;
+		nextBand = 0;
+		numBands = 0;
+
+		startSem = SDL_CreateSemaphore(0);
+		doneSem = SDL_CreateSemaphore(0);
+
+		for(int i = 0; i < numThreads - 1; i++)
+		{
+			SDL_Thread* t = SDL_CreateThread(workerThread, this);
+			if(t != NULL)
+				workers.push_back(t);
+		}
+	}
+
+	virtual ~BandRasterizer()
+	{
+		quit = true;
+		for(unsigned int i = 0; i < workers.size(); i++)
+			SDL_SemPost(startSem);
+		for(unsigned int i = 0; i < workers.size(); i++)
+			SDL_WaitThread(workers[i], NULL);
+
+		SDL_DestroySemaphore(startSem);
+		SDL_DestroySemaphore(doneSem);
+	}
+
+	// draws every call in the snapshot to target, in bands across the worker threads when possible
+	void render(RenderSnapshot* s, SDL_Surface* target)
+	{
+		Uint32 start = SDL_GetTicks();
+
+		lastBanded = !workers.empty() && canBand(s, target);
+		if(!lastBanded)
+		{
+			s->replay(target);
+			lastRenderTime = SDL_GetTicks() - start;
+			return;
+		}
+
+		snapshot = s;
+		dst = target;
+		numBands = (workers.size() + 1) * BANDS_PER_THREAD;
+		if(numBands > dst->clip_rect.h)
+			numBands = dst->clip_rect.h > 0 ? dst->clip_rect.h : 1;
+		nextBand = 0;
+
+		for(unsigned int i = 0; i < workers.size(); i++)
+			SDL_SemPost(startSem);
+
+		drawBands(); // this thread helps out too
+
+		for(unsigned int i = 0; i < workers.size(); i++)
+			SDL_SemWait(doneSem);
+
+		snapshot = NULL;
+		dst = NULL;
+
+		lastRenderTime = SDL_GetTicks() - start;
+	}
+
+	// true if every call in the snapshot can be drawn by the workers' own blitters
+	static bool canBand(RenderSnapshot* s, SDL_Surface* target)
+	{
+		SDL_PixelFormat* f = target->format;
+		if(f->BytesPerPixel != 4 || f->Amask != 0 || SDL_MUSTLOCK(target)) // locking isn't thread safe
+			return false;
+
+		std::vector<DrawCmd>* cmds = s->getCmds();
+		for(unsigned int i = 0; i < cmds->size(); i++)
+		{
+			DrawCmd* c = &cmds->at(i);
+
+			if(c->rle != NULL)
+			{
+				if(!c->rle->canBlitTo(target))
+					return false;
+				continue;
+			}
+
+			SDL_PixelFormat* sf = c->src->format;
+			if(sf->BytesPerPixel != 4 || sf->Rmask != f->Rmask || sf->Gmask != f->Gmask || sf->Bmask != f->Bmask ||
+				sf->Amask != 0 || (c->src->flags & SDL_SRCALPHA) || SDL_MUSTLOCK(c->src))
+				return false;
+		}
+
+		return true;
+	}
+
+	// same result as SDL_BlitSurface(src,srcRect,dst,&(x,y)) for two 32 bit surfaces of the same format,
+	// except drawing is limited to clip instead of dst's clip rect, and nothing on either surface is modified
+	// (which is what makes it safe to call from several threads at once)
+	static void blitClipped(SDL_Surface* src, SDL_Rect* srcRect, SDL_Surface* dst, int x, int y, SDL_Rect* clip)
+	{
+		int sx = 0, sy = 0, w = src->w, h = src->h;
+		if(srcRect != NULL)
+		{
+			sx = srcRect->x;
+			sy = srcRect->y;
+			w = srcRect->w;
+			h = srcRect->h;
+		}
+
+		// clip to the source surface
+		if(sx < 0)
+		{
+			w += sx;
+			x -= sx;
+			sx = 0;
+		}
+		if(sy < 0)
+		{
+			h += sy;
+			y -= sy;
+			sy = 0;
+		}
+		if(sx + w > src->w)
+			w = src->w - sx;
+		if(sy + h > src->h)
+			h = src->h - sy;
+
+		// clip to the destination area
+		if(x < clip->x)
+		{
+			sx += clip->x - x;
+			w -= clip->x - x;
+			x = clip->x;
+		}
+		if(y < clip->y)
+		{
+			sy += clip->y - y;
+			h -= clip->y - y;
+			y = clip->y;
+		}
+		if(x + w > clip->x + clip->w)
+			w = clip->x + clip->w - x;
+		if(y + h > clip->y + clip->h)
+			h = clip->y + clip->h - y;
+
+		if(w <= 0 || h <= 0)
+			return;
+
+		bool keyed = (src->flags & SDL_SRCCOLORKEY) != 0;
+		Uint32 key = src->format->colorkey;
+
+		for(int row = 0; row < h; row++)
+		{
+			Uint32* s = (Uint32*)((Uint8*)src->pixels + (sy + row) * src->pitch) + sx;
+			Uint32* d = (Uint32*)((Uint8*)dst->pixels + (y + row) * dst->pitch) + x;
+
+			if(!keyed)
+			{
+				memcpy(d, s, w * 4);
+				continue;
+			}
+
+			for(int i = 0; i < w; i++)
+			{
+				if(s[i] != key)
+					d[i] = s[i];
+			}
+		}
+	}
+
+protected:
+	int numThreads;
+	std::vector<SDL_Thread*> workers;
+	SDL_sem* startSem; // posted once per worker to start a frame (or to quit)
+	SDL_sem* doneSem; // posted by each worker when it runs out of bands
+	std::atomic<bool> quit;
+
+	// the frame being drawn, only valid between the start and done semaphores
+	RenderSnapshot* snapshot;
+	SDL_Surface* dst;
+	int numBands;
+	std::atomic<int> nextBand; // next band nobody has claimed yet
+
+	Uint32 lastRenderTime;
+	bool lastBanded;
+
+	static int workerThread(void* data)
+	{
+		BandRasterizer* r = (BandRasterizer*)data;
+
+		while(true)
+		{
+			SDL_SemWait(r->startSem);
+			if(r->quit)
+				break;
+
+			r->drawBands();
+			SDL_SemPost(r->doneSem);
+		}
+
+		return 0;
+	}
+
+	// claims and draws bands until there are none left
+	void drawBands()
+	{
+		SDL_Rect area = dst->clip_rect;
+
+		while(true)
+		{
+			int band = nextBand.fetch_add(1);
+			if(band >= numBands)
+				break;
+
+			int y0 = area.y + area.h * band / numBands;
+			int y1 = area.y + area.h * (band + 1) / numBands;
+
+			SDL_Rect clip;
+			clip.x = area.x;
+			clip.y = y0;
+			clip.w = area.w;
+			clip.h = y1 - y0;
+
+			drawBand(&clip);
+		}
+	}
+
+	void drawBand(SDL_Rect* clip)
+	{
+		std::vector<DrawCmd>* cmds = snapshot->getCmds();
+
+		for(unsigned int i = 0; i < cmds->size(); i++)
+		{
+			DrawCmd* c = &cmds->at(i);
+			SDL_Rect srcClip = c->clip;
+
+			if(c->rle != NULL)
+				c->rle->blit(dst, c->x, c->y, c->clipped ? &srcClip : NULL, clip);
+			else
+				blitClipped(c->src, c->clipped ? &srcClip : NULL, dst, c->x, c->y, clip);
+		}
+	}
+
+};
+	// END OF: BAND RASTERIZER -----------------------------------
+#endif
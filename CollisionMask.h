@@ -0,0 +1,158 @@
+/*CollisionMask.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* 1 bit per pixel collision mask of a sprite, generated from its color key: a bit is set wherever the
+* sprite is opaque. Rows are packed into 64 bit words, so checking two masks against each other
+* ANDs 64 pixels at a time instead of looking at them one by one.
+*
+* Meant as a narrowphase: the cheap hitbox (AABB) check runs first, and only pairs whose boxes overlap
+* get their masks compared, which makes round or oddly shaped sprites collide exactly for not much more
+* than the cost of the box check.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "SDL.h"
+#include "SurfaceUtils.h"
+
+#ifndef COLLISIONMASK_H
+#define COLLISIONMASK_H
+
+//------------------------------- CLASS: COLLISION MASK ----------------------------------
+class CollisionMask
+{
+
+public:
+	int getW()							{return w;}
+	int getH()							{return h;}
+	int getBytes()						{return bits.size() * sizeof(Uint64);}
+
+	// builds the mask from a surface, treating its color key (or 255,0,255 if it has none) as empty
+	CollisionMask(SDL_Surface* src)
+	{
+		w = src->w;
+		h = src->h;
+		wordsPerRow = (w + 63) / 64;
+		bits.assign(wordsPerRow * h, 0);
+
+		Uint32 key = (src->flags & SDL_SRCCOLORKEY) ? src->format->colorkey : SurfaceUtils::mapColorKey(src->format);
+
+		if(SDL_MUSTLOCK(src))
+			SDL_LockSurface(src);
+
+		for(int y = 0; y < h; y++)
+		{
+			for(int x = 0; x < w; x++)
+			{
+				if(SurfaceUtils::getPixel(src, x, y) != key)
+					bits[y * wordsPerRow + (x >> 6)] |= (Uint64)1 << (x & 63);
+			}
+		}
+
+		if(SDL_MUSTLOCK(src))
+			SDL_UnlockSurface(src);
+	}
+
+	virtual ~CollisionMask()
+	{
+
+	}
+
+	// true if the pixel at (x,y) is solid
+	bool isSolid(int x, int y)
+	{
+		if(x < 0 || y < 0 || x >= w || y >= h)
+			return false;
+
+		return (bits[y * wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+	}
+
+	// returns true if any solid pixel of mask a drawn at (ax,ay) lands on a solid pixel of mask b drawn at (bx,by)
+	// the clips pick out the piece of each sprite actually being drawn (as with Game2D::draw), NULL for all of it
+	static bool overlaps(CollisionMask* a, int ax, int ay, SDL_Rect* aClip, CollisionMask* b, int bx, int by, SDL_Rect* bClip)
+	{
+		// area of each sprite on screen, and where that area starts within the mask
+		int aox = 0, aoy = 0, aw = a->w, ah = a->h;
+		int box = 0, boy = 0, bw = b->w, bh = b->h;
+		if(aClip != NULL)
+		{
+			aox = aClip->x;
+			aoy = aClip->y;
+			aw = aClip->w;
+			ah = aClip->h;
+		}
+		if(bClip != NULL)
+		{
+			box = bClip->x;
+			boy = bClip->y;
+			bw = bClip->w;
+			bh = bClip->h;
+		}
+
+		// overlapping region on screen
+		int x0 = ax > bx ? ax : bx;
+		int y0 = ay > by ? ay : by;
+		int x1 = (ax + aw) < (bx + bw) ? (ax + aw) : (bx + bw);
+		int y1 = (ay + ah) < (by + bh) ? (ay + ah) : (by + bh);
+
+		for(int y = y0; y < y1; y++)
+		{
+			int rowA = y - ay + aoy;
+			int rowB = y - by + boy;
+			if(rowA < 0 || rowB < 0 || rowA >= a->h || rowB >= b->h)
+				continue;
+
+			for(int x = x0; x < x1; x += 64)
+			{
+				int n = (x1 - x) < 64 ? (x1 - x) : 64;
+				if(a->extract(rowA, x - ax + aox, n) & b->extract(rowB, x - bx + box, n))
+					return true;
+			}
+		}
+
+		return false;
+	}
+
+protected:
+	int w, h;
+	int wordsPerRow;
+	std::vector<Uint64> bits; // row major, bit (x & 63) of word (x >> 6) is pixel x; padding bits are always 0
+
+	// returns n (1 to 64) bits of a row starting at pixel start, lined up so the first one is bit 0
+	// pixels outside the mask read as empty
+	Uint64 extract(int row, int start, int n)
+	{
+		Uint64 v = 0;
+
+		if(start < 0)
+		{
+			if(start <= -n)
+				return 0;
+
+			// the first -start pixels are off the left edge
+			v = extract(row, 0, n + start) << (-start);
+			return v;
+		}
+
+		int word = start >> 6;
+		int shift = start & 63;
+		if(word >= wordsPerRow)
+			return 0;
+
+		const Uint64* r = &bits[row * wordsPerRow];
+		v = r[word] >> shift;
+		if(shift != 0 && word + 1 < wordsPerRow)
+			v |= r[word + 1] << (64 - shift);
+
+		if(n < 64)
+			v &= ((Uint64)1 << n) - 1;
+
+		return v;
+	}
+
+};
+	// END OF: COLLISION MASK -----------------------------------
+#endif
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "SDL.h"
+#include "MemoryTracker.h"
 
 #ifndef FPSMANAGER_H
 #define FPSMANAGER_H
@@ -18,6 +19,12 @@ public:
 	FPSManager()
 	{
 		startTime = 0;
+		MEM_TRACK(MEM_MANAGERS, sizeof(FPSManager));
+	}
+
+	~FPSManager()
+	{
+		MEM_UNTRACK(MEM_MANAGERS, sizeof(FPSManager));
 	}
 
 	// mark the current time
@@ -0,0 +1,469 @@
+/*FontManager.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Bitmap font support. A font is a single glyph sheet image (loaded through the SpriteManager like any
+* other sprite, so it's colorkeyed the same way) plus a small text file describing where each glyph
+* sits on the sheet and how far to move the pen after drawing it.
+*
+* Font file format (same spirit as images.txt, one entry per line, terminated by END):
+*	images/font.png					<- first line is always the glyph sheet
+*	LINEHEIGHT 16					<- vertical distance between lines of text
+*	GRID 8 16 32 96					<- optional: cell width, cell height, first char, glyph count for a
+*									   monospaced sheet laid out left to right, top to bottom
+*	65 0 0 8 16 0 0 9				<- char code, x, y, w, h on the sheet, x offset, y offset, advance
+*	END
+* Glyph lines override anything a GRID line set up, so the two can be mixed.
+*
+* Laying out a string (turning it into a list of glyph clips and pen positions) is cached per font for
+* recently drawn strings. Text that rarely changes (scores, HUD labels) can instead be drawn as "static
+* text", which is rendered once to its own surface and only rendered again when the string changes.
+*/
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+#include "SDL.h"
+#include "SpriteManager.h"
+#include "SurfaceUtils.h"
+#include "MemoryTracker.h"
+
+#ifndef FONTMANAGER_H
+#define FONTMANAGER_H
+
+#define DEFAULT_LAYOUT_CACHE_SIZE 128 // number of laid out strings each font remembers
+
+//--------------------- STRUCT : GLYPH
+// where a character lives on the glyph sheet and how it's positioned relative to the pen
+struct Glyph
+{
+	SDL_Rect clip; // area of the sheet holding this glyph
+	int xOffset; // offset from the pen to where the glyph is drawn
+	int yOffset;
+	int advance; // how far the pen moves after this glyph
+	bool valid;
+};
+	//END OF: GLYPH---------------------
+
+//--------------------- STRUCT : PLACED GLYPH
+// a single glyph of a laid out string, positioned relative to the string's top left corner
+struct PlacedGlyph
+{
+	SDL_Rect clip;
+	int x;
+	int y;
+};
+	//END OF: PLACED GLYPH---------------------
+
+//--------------------- STRUCT : TEXT LAYOUT
+// the glyph run for a whole string along with the size of the area it covers
+struct TextLayout
+{
+	std::vector<PlacedGlyph> glyphs;
+	int w;
+	int h;
+};
+	//END OF: TEXT LAYOUT---------------------
+
+
+//------------------------------- CLASS: BITMAP FONT ----------------------------------
+class BitmapFont
+{
+
+public:
+	SDL_Surface* getSheet()				{return sheet;}
+	std::string getSheetName()			{return sheetName;}
+	int getLineHeight()					{return lineHeight;}
+	Glyph* getGlyph(unsigned char c)	{return &glyphs[c];}
+
+	void setLayoutCacheSize(unsigned int i)	{layoutCacheSize = i; trimLayouts();}
+	void setLineHeight(int i)				{lineHeight = i; clearLayouts();}
+	void setSheet(SDL_Surface* s)			{sheet = s;} // glyph positions are kept, only the pixels change
+
+	// sheetName is the SpriteManager key of glyphSheet, so the sheet can be looked up again after a hot reload
+	BitmapFont(SDL_Surface* glyphSheet, int lh, std::string name = "")
+	{
+		sheet = glyphSheet;
+		sheetName = name;
+		lineHeight = lh;
+		layoutCacheSize = DEFAULT_LAYOUT_CACHE_SIZE;
+
+		for(int i = 0; i < 256; i++)
+		{
+			glyphs[i].clip.x = glyphs[i].clip.y = 0;
+			glyphs[i].clip.w = glyphs[i].clip.h = 0;
+			glyphs[i].xOffset = glyphs[i].yOffset = glyphs[i].advance = 0;
+			glyphs[i].valid = false;
+		}
+	}
+
+	virtual ~BitmapFont()
+	{
+		// the sheet belongs to the SpriteManager, so it isn't freed here
+		clearLayouts();
+	}
+
+	void setGlyph(unsigned char c, int x, int y, int w, int h, int xOff, int yOff, int adv)
+	{
+		Glyph* g = &glyphs[c];
+		g->clip.x = x;
+		g->clip.y = y;
+		g->clip.w = w;
+		g->clip.h = h;
+		g->xOffset = xOff;
+		g->yOffset = yOff;
+		g->advance = adv;
+		g->valid = true;
+
+		clearLayouts(); // metrics changed, old layouts are no longer accurate
+	}
+
+	// sets up glyphs for a monospaced sheet of (cw x ch) cells, starting at character first
+	void setGrid(int cw, int ch, int first, int count)
+	{
+		if(sheet == NULL || cw < 1 || ch < 1)
+			return;
+
+		int columns = sheet->w / cw;
+		if(columns < 1)
+			return;
+
+		for(int i = 0; i < count && first + i < 256; i++)
+			setGlyph(first + i, (i % columns) * cw, (i / columns) * ch, cw, ch, 0, 0, cw);
+	}
+
+	// returns the glyph run for the text, laying it out only if it isn't one of the recently used strings
+	const TextLayout* getLayout(const std::string& text)
+	{
+		std::map<std::string, std::list<LayoutEntry>::iterator>::iterator found = layoutIndex.find(text);
+		if(found != layoutIndex.end())
+		{
+			// move to the front of the recently used list
+			layouts.splice(layouts.begin(), layouts, found->second);
+			return &found->second->layout;
+		}
+
+		layouts.push_front(LayoutEntry());
+		layouts.front().text = text;
+		layoutText(text, &layouts.front().layout);
+		layoutIndex[text] = layouts.begin();
+
+		trimLayouts();
+
+		return &layouts.front().layout;
+	}
+
+	// drops every cached layout
+	void clearLayouts()
+	{
+		layouts.clear();
+		layoutIndex.clear();
+	}
+
+protected:
+	struct LayoutEntry
+	{
+		std::string text;
+		TextLayout layout;
+	};
+
+	SDL_Surface* sheet; // the glyph atlas
+	std::string sheetName; // its key in the SpriteManager, empty if it didn't come from there
+	int lineHeight;
+	Glyph glyphs[256];
+
+	unsigned int layoutCacheSize;
+	std::list<LayoutEntry> layouts; // most recently used first
+	std::map<std::string, std::list<LayoutEntry>::iterator> layoutIndex;
+
+	// turns a string into a glyph run; newlines start a new line, and characters the font doesn't
+	// have just advance the pen by half a line height (so spaces work even without a glyph)
+	void layoutText(const std::string& text, TextLayout* out)
+	{
+		int penX = 0, penY = 0;
+
+		out->glyphs.clear();
+		out->glyphs.reserve(text.size());
+		out->w = 0;
+		out->h = text.empty() ? 0 : lineHeight;
+
+		for(unsigned int i = 0; i < text.size(); i++)
+		{
+			unsigned char c = text[i];
+
+			if(c == '\n')
+			{
+				penX = 0;
+				penY += lineHeight;
+				out->h = penY + lineHeight;
+				continue;
+			}
+
+			Glyph* g = &glyphs[c];
+			if(!g->valid)
+			{
+				penX += lineHeight / 2;
+				if(penX > out->w)
+					out->w = penX;
+				continue;
+			}
+
+			PlacedGlyph p;
+			p.clip = g->clip;
+			p.x = penX + g->xOffset;
+			p.y = penY + g->yOffset;
+			out->glyphs.push_back(p);
+
+			if(p.x + g->clip.w > out->w)
+				out->w = p.x + g->clip.w;
+			if(p.y + g->clip.h > out->h)
+				out->h = p.y + g->clip.h;
+
+			penX += g->advance;
+			if(penX > out->w)
+				out->w = penX;
+		}
+	}
+
+	void trimLayouts()
+	{
+		while(layouts.size() > layoutCacheSize && !layouts.empty())
+		{
+			layoutIndex.erase(layouts.back().text);
+			layouts.pop_back();
+		}
+	}
+
+};
+	// END OF: BITMAP FONT -----------------------------------
+
+
+//------------------------------- CLASS: FONT MANAGER ----------------------------------
+class FontManager
+{
+
+public:
+	std::map<std::string,BitmapFont*>* getFonts()		{return fonts;}
+
+	FontManager(SpriteManager* sm)
+	{
+		spriteMan = sm;
+		fonts = new std::map<std::string,BitmapFont*>();
+		staticTexts = new std::map<std::string,StaticText>();
+		MEM_TRACK(MEM_MANAGERS, sizeof(FontManager));
+	}
+
+	virtual ~FontManager()
+	{
+		clearStaticTexts();
+		delete staticTexts;
+
+		clearFonts();
+		delete fonts;
+		MEM_UNTRACK(MEM_MANAGERS, sizeof(FontManager));
+	}
+
+	// returns the font loaded under this name, or NULL if there isn't one
+	BitmapFont* getFont(std::string name)
+	{
+		std::map<std::string,BitmapFont*>::iterator it = fonts->find(name);
+		if(it == fonts->end())
+			return NULL;
+
+		return it->second;
+	}
+
+	// loads a font description file (see top of file for the format) and stores the font under name
+	// the glyph sheet is pulled in through the SpriteManager; returns false if the sheet couldn't be loaded
+	virtual bool loadFont(std::string name, std::string fileName)
+	{
+		std::ifstream file(fileName.c_str());
+		std::string line;
+
+		if(!getline(file,line))
+			return false;
+
+		SDL_Surface* sheet = spriteMan->getOrLoadImage(line);
+		if(sheet == NULL)
+			return false;
+
+		BitmapFont* font = new BitmapFont(sheet, 0, line);
+
+		while(getline(file,line)) // read until we come upon an "END" tag (or the file runs out)
+		{
+			if(line == "END")
+				break;
+			if(line.empty())
+				continue;
+
+			std::istringstream in(line);
+			std::string first;
+			in >> first;
+
+			if(first == "LINEHEIGHT")
+			{
+				int lh = 0;
+				in >> lh;
+				font->setLineHeight(lh);
+			}
+			else if(first == "GRID")
+			{
+				int cw = 0, ch = 0, start = 0, count = 0;
+				in >> cw >> ch >> start >> count;
+				font->setGrid(cw, ch, start, count);
+				if(font->getLineHeight() == 0)
+					font->setLineHeight(ch);
+			}
+			else
+			{
+				int c = atoi(first.c_str());
+				int x = 0, y = 0, w = 0, h = 0, xOff = 0, yOff = 0, adv = 0;
+				in >> x >> y >> w >> h >> xOff >> yOff >> adv;
+				if(c >= 0 && c < 256)
+					font->setGlyph(c, x, y, w, h, xOff, yOff, adv);
+			}
+		}
+
+		file.close();
+
+		return addFont(name, font);
+	}
+
+	// stores an already built font under name; the manager takes ownership of it
+	bool addFont(std::string name, BitmapFont* font)
+	{
+		if(font == NULL)
+			return false;
+
+		std::map<std::string,BitmapFont*>::iterator it = fonts->find(name);
+		if(it != fonts->end())
+		{
+			delete it->second;
+			it->second = font;
+		}
+		else
+			fonts->insert(std::pair<std::string,BitmapFont*>(name,font));
+
+		return true;
+	}
+
+	void clearFonts()
+	{
+		for(std::map<std::string,BitmapFont*>::iterator it = fonts->begin(); it != fonts->end(); it++)
+			delete it->second;
+
+		fonts->clear();
+	}
+
+	// points every font back at its glyph sheet in the SpriteManager; a hot reload that changes a sheet's size
+	// swaps in a new surface and frees the old one, which the font would otherwise still be using
+	void refreshSheets()
+	{
+		for(std::map<std::string,BitmapFont*>::iterator it = fonts->begin(); it != fonts->end(); it++)
+		{
+			BitmapFont* font = it->second;
+			if(!font->getSheetName().empty() && spriteMan->hasImage(font->getSheetName()))
+				font->setSheet(spriteMan->getImage(font->getSheetName()));
+		}
+	}
+
+	// returns a surface with the text pre rendered on it, identified by label (e.g "score")
+	// the surface is reused for as long as the label keeps getting the same text and font, and re-rendered
+	// only when either changes; returns NULL if the font doesn't exist or the text is empty
+	SDL_Surface* getStaticText(std::string label, std::string fontName, const std::string& text)
+	{
+		std::map<std::string,StaticText>::iterator it = staticTexts->find(label);
+		if(it != staticTexts->end() && it->second.text == text && it->second.font == fontName)
+			return it->second.surface;
+
+		BitmapFont* font = getFont(fontName);
+		if(font == NULL)
+			return NULL;
+
+		if(it == staticTexts->end())
+		{
+			StaticText st;
+			st.surface = NULL;
+			it = staticTexts->insert(std::pair<std::string,StaticText>(label,st)).first;
+		}
+
+		releaseText(it->second.surface);
+		it->second.text = text;
+		it->second.font = fontName;
+		it->second.surface = renderText(font, text);
+		if(it->second.surface != NULL)
+			MEM_TRACK(MEM_SURFACES, SurfaceUtils::surfaceBytes(it->second.surface));
+
+		return it->second.surface;
+	}
+
+	// forgets a single static text, freeing its surface
+	void clearStaticText(std::string label)
+	{
+		std::map<std::string,StaticText>::iterator it = staticTexts->find(label);
+		if(it == staticTexts->end())
+			return;
+
+		releaseText(it->second.surface);
+		staticTexts->erase(it);
+	}
+
+	void clearStaticTexts()
+	{
+		for(std::map<std::string,StaticText>::iterator it = staticTexts->begin(); it != staticTexts->end(); it++)
+			releaseText(it->second.surface);
+
+		staticTexts->clear();
+	}
+
+	// renders text onto a new keyed surface just big enough to hold it; caller owns the result
+	static SDL_Surface* renderText(BitmapFont* font, const std::string& text)
+	{
+		const TextLayout* layout = font->getLayout(text);
+		if(layout->glyphs.empty())
+			return NULL;
+
+		SDL_Surface* s = SurfaceUtils::createKeyedSurface(layout->w, layout->h);
+		if(s == NULL)
+			return NULL;
+
+		// copied by hand rather than blitted: this runs while recording a frame, when the main thread may be
+		// blitting the same sheet (pipelined rendering), and SDL blits can't share a source across threads
+		for(unsigned int i = 0; i < layout->glyphs.size(); i++)
+		{
+			SDL_Rect clip = layout->glyphs[i].clip;
+			SurfaceUtils::copyKeyed(font->getSheet(), &clip, s, layout->glyphs[i].x, layout->glyphs[i].y);
+		}
+
+		return s;
+	}
+
+protected:
+	struct StaticText
+	{
+		std::string text;
+		std::string font;
+		SDL_Surface* surface;
+	};
+
+	SpriteManager* spriteMan; // used to load glyph sheets
+	std::map<std::string,BitmapFont*>* fonts; // fonts by name
+	std::map<std::string,StaticText>* staticTexts; // pre rendered text by label
+
+	static void releaseText(SDL_Surface* s)
+	{
+		if(s != NULL)
+			MEM_UNTRACK(MEM_SURFACES, SurfaceUtils::surfaceBytes(s));
+		SurfaceUtils::releaseSurface(s);
+	}
+
+};
+	// END OF: FONT MANAGER -----------------------------------
+#endif
@@ -0,0 +1,102 @@
+/*FrameArena.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* A block of memory handed out in pieces for data that only has to live until the end of the frame (or
+* some other known point), at which point the whole thing is reset at once. Allocating is just bumping an
+* atomic offset, so it's cheap, never calls the heap, and is safe from several threads at once.
+*
+* Nothing allocated from an arena has its destructor called, so it should only hold plain data.
+* If an arena runs out, alloc returns NULL; the next reset then grows it so the following frame fits.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#define ARENA_ALIGNMENT 16 // every allocation starts on a multiple of this
+
+//------------------------------- CLASS: FRAME ARENA ----------------------------------
+class FrameArena
+{
+
+public:
+	size_t getCapacity()				{return capacity;}
+	bool hasOverflowed()				{return overflowed;}
+
+	// bytes handed out since the last reset
+	size_t getUsed()
+	{
+		size_t used = offset.load(std::memory_order_relaxed);
+		return used < capacity ? used : capacity;
+	}
+
+	FrameArena(size_t bytes)
+	{
+		capacity = roundUp(bytes);
+		memory = (char*)malloc(capacity + ARENA_ALIGNMENT);
+		offset = 0;
+		overflowed = false;
+	}
+
+	virtual ~FrameArena()
+	{
+		free(memory);
+	}
+
+	// returns bytes of memory valid until the next reset, or NULL if the arena is full; thread safe
+	void* alloc(size_t bytes)
+	{
+		size_t size = roundUp(bytes);
+		size_t start = offset.fetch_add(size, std::memory_order_relaxed);
+
+		if(start + size > capacity)
+		{
+			overflowed = true;
+			return NULL;
+		}
+
+		return base() + start;
+	}
+
+	// frees everything at once; if the arena ran out since the last reset it's grown here to fit everything
+	// that was asked for. Must not be called while other threads could be allocating
+	void reset()
+	{
+		if(overflowed)
+		{
+			size_t wanted = offset.load(std::memory_order_relaxed);
+			free(memory);
+			while(capacity < wanted)
+				capacity *= 2;
+			memory = (char*)malloc(capacity + ARENA_ALIGNMENT);
+			overflowed = false;
+		}
+
+		offset.store(0, std::memory_order_relaxed);
+	}
+
+	static size_t roundUp(size_t bytes)
+	{
+		return (bytes + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	}
+
+protected:
+	char* memory;
+	size_t capacity;
+	std::atomic<size_t> offset; // next free byte
+	std::atomic<bool> overflowed;
+
+	// first aligned byte of the memory block
+	char* base()
+	{
+		return (char*)roundUp((size_t)memory);
+	}
+
+};
+	// END OF: FRAME ARENA -----------------------------------
+#endif
@@ -18,7 +18,12 @@
 
 #include "GameManager.h"
 #include "SpriteManager.h"
+#include "FontManager.h"
+#include "AudioManager.h"
 #include "FPSManager.h"
+#include "RenderPipeline.h"
+#include "GameState.h"
+#include "MemoryTracker.h"
 
 //-------------------- CONSTANTS ----------------------
 #define DEFAULT_SCREEN_WIDTH 640
@@ -36,6 +41,7 @@
 #define GAMEOVER 3
 #define	MENU 4
 #define CUTSCENE 5
+#define NO_STATE -2 // the state before the first frame; never registered
 
 // XBOX CONTROLLER - appropriate constants for an xbox 360 controller should 1 be supported
 #define A_BTN 0
@@ -58,20 +64,60 @@ class Game2D
 		{
 			spriteMan = NULL;
 			gameMan = NULL;
+			fontMan = NULL;
+			audioMan = NULL;
+			pipeline = NULL;
+			recording = NULL;
+			pipelinedRendering = false;
+			rasterizer = NULL;
+			rasterThreads = 0;
+			currentState = NO_STATE;
+			memHUDInterval = 0;
+			memHUDFrames = 0;
 		}
 
+		// what registered states (and anything else given the game) use to get at it, e.g. in a GameState's update:
+		// "game->getGameManager()->update();" or "game->getAudioManager()->play("files/jump.wav");"
+		GameManager* getGameManager()			{return gameMan;}
+		SpriteManager* getSpriteManager()		{return spriteMan;}
+		FontManager* getFontManager()			{return fontMan;}
+		AudioManager* getAudioManager()		{return audioMan;}
+		int getScreenWidth()					{return screenWidth;}
+		int getScreenHeight()					{return screenHeight;}
+		bool isQuitting()						{return quit;}
+		void quitGame()							{quit = true;} // the game loop ends after this frame
+
 		//GAME 2D DESTRUCTOR
 		// will be called after the destructor of child class is invoked
 		virtual ~Game2D()
 		{
 			SDL_JoystickClose(js);
 			SDL_FreeSurface(screen);
+			delete audioMan; // closes the sound device, so before SDL goes
 			SDL_Quit();
 
+			for(unsigned int i = 0; i < states.size(); i++)
+				delete states[i];
+
+			delete fontMan; // fonts reference sprite sheets, so they go before the sprite manager
 			delete spriteMan;
 			delete gameMan;
+
+			MemoryTracker::report(); // anything the engine made and never freed shows up here (if tracking is built in)
 		}
 		
+		// when on, the game (input handling, updates, recording what to draw) runs on a simulation thread while
+		// the main thread draws and flips the previous frame (see RenderPipeline.h); must be set before start
+		// NOTE: only drawing done through the draw/drawText methods ends up on screen, and game code must not
+		// call SDL video or event functions (use pollEvent rather than SDL_PollEvent), nor blit sprites with
+		// applySurface, since the main thread may be drawing them at the same time
+		void setPipelinedRendering(bool b)		{pipelinedRendering = b;}
+
+		// when threads is more than 1, each frame is recorded and then drawn by that many threads, each
+		// filling its own horizontal bands of the screen (see BandRasterizer.h); 0 or 1 draws normally
+		// works with or without pipelined rendering, and has the same restrictions on drawing; set before start
+		void setBandedRendering(int threads)	{rasterThreads = threads;}
+
 		//called to start the engine
 		void start(int sw, int sh, int fps,std::string title, bool fullScreen, int gs)
 		{
@@ -114,6 +160,12 @@ class Game2D
 		// and used to draw the full image
 		void draw(SDL_Surface* src, int x, int y, SDL_Rect* clip = NULL)
 		{
+			if(recording != NULL) // pipelined or banded, the recorded frame is drawn later
+			{
+				recording->add(src,NULL,x,y,clip);
+				return;
+			}
+
 			SDL_Rect offset;
 			offset.x = x;
 			offset.y = y;
@@ -121,10 +173,172 @@ class Game2D
 			SDL_BlitSurface(src,clip,screen,&offset);
 		}
 
+		// adds a state to the state table under the number id, replacing (and deleting) any state already there
+		// the built in states use SPLASHSCREEN through CUTSCENE, so new ones should use numbers above CUTSCENE
+		// the game takes ownership of the state
+		void registerState(int id, GameState* s)
+		{
+			if(id < SPLASHSCREEN)
+				return;
+
+			unsigned int i = id - SPLASHSCREEN;
+			if(i >= states.size())
+				states.resize(i + 1, NULL);
+
+			if(states[i] != s)
+				delete states[i];
+			states[i] = s;
+		}
+
+		// returns the state registered under id, or NULL if there isn't one
+		GameState* getState(int id)
+		{
+			unsigned int i = id - SPLASHSCREEN;
+			if(id < SPLASHSCREEN || i >= states.size())
+				return NULL;
+
+			return states[i];
+		}
+
+		// the state whose update and draw are being called this frame (gameState may already hold the next one)
+		int getCurrentState()					{return currentState;}
+
+		// asks for the game to switch to state id; the switch happens at the start of a later frame, once all
+		// of the state's preload images have loaded. Same as setting gameState, which also still works
+		// if any of them can't be loaded, the switch is called off (see updateStateChange); asking again retries them
+		void changeState(int id)
+		{
+			GameState* s = getState(id);
+			if(s != NULL)
+			{
+				for(unsigned int i = 0; i < s->getPreloadImages()->size(); i++)
+					spriteMan->clearFailed(s->getPreloadImages()->at(i));
+			}
+
+			gameState = id;
+			preloadState(id);
+		}
+
+		// starts loading a state's preload images in the background without switching to it, e.g. to get the
+		// next level ready while the current one is being played
+		void preloadState(int id)
+		{
+			GameState* s = getState(id);
+			if(s == NULL)
+				return;
+
+			for(unsigned int i = 0; i < s->getPreloadImages()->size(); i++)
+				spriteMan->requestImage(s->getPreloadImages()->at(i));
+		}
+
+		// true once every preload image of a state is in the sprite manager (never, if one failed to load)
+		bool isStateLoaded(int id)
+		{
+			GameState* s = getState(id);
+			if(s == NULL)
+				return true;
+
+			for(unsigned int i = 0; i < s->getPreloadImages()->size(); i++)
+			{
+				std::string name = s->getPreloadImages()->at(i);
+				if(!spriteMan->hasImage(name) || spriteMan->hasFailed(name))
+					return false;
+			}
+
+			return true;
+		}
+
+		// true if any of a state's preload images couldn't be loaded; each one is printed to stderr
+		bool reportFailedPreloads(int id)
+		{
+			GameState* s = getState(id);
+			if(s == NULL)
+				return false;
+
+			bool any = false;
+			for(unsigned int i = 0; i < s->getPreloadImages()->size(); i++)
+			{
+				if(spriteMan->hasFailed(s->getPreloadImages()->at(i)))
+				{
+					fprintf(stderr, "state %d: couldn't load preload image %s\n", id, s->getPreloadImages()->at(i).c_str());
+					any = true;
+				}
+			}
+
+			return any;
+		}
+
+		// draws the named sprite; same as drawing spriteMan->getImage(imageName), except sprites that have a run
+		// length encoded copy (see RLESprite.h) are drawn from that, skipping their transparent pixels entirely
+		void draw(std::string imageName, int x, int y, SDL_Rect* clip = NULL)
+		{
+			RLESprite* rle = spriteMan->getRLEImage(imageName);
+			if(rle != NULL && rle->canBlitTo(screen))
+			{
+				if(recording != NULL)
+					recording->add(NULL,rle,x,y,clip);
+				else
+					rle->blit(screen, x, y, clip);
+			}
+			else
+				draw(spriteMan->getImage(imageName), x, y, clip);
+		}
+
+		// draws the named sprite rotated by angle degrees (clockwise) and scaled by scale
+		// the result is centered where the untransformed sprite would be drawn at (x,y), so an object can spin in
+		// place without adjusting its position; variants come from the sprite manager's transform cache
+		void draw(std::string imageName, int x, int y, double angle, double scale)
+		{
+			SDL_Surface* src = spriteMan->getImage(imageName);
+			SDL_Surface* variant = spriteMan->getTransformedImage(imageName, angle, scale);
+			if(variant == NULL)
+				return;
+
+			draw(variant, x + (src->w - variant->w) / 2, y + (src->h - variant->h) / 2);
+		}
+
+		// draws text at (x,y) using a font previously loaded into the font manager, e.g:
+		// "fontMan->loadFont("small","files/smallFont.txt");" in initPostScreen, then "drawText("small","Hello",10,10);"
+		// strings drawn recently have their layout cached, so drawing the same text every frame is cheap
+		void drawText(std::string font, std::string text, int x, int y)
+		{
+			BitmapFont* f = fontMan->getFont(font);
+			if(f == NULL)
+				return;
+
+			const TextLayout* layout = f->getLayout(text);
+			for(unsigned int i = 0; i < layout->glyphs.size(); i++)
+			{
+				SDL_Rect clip = layout->glyphs[i].clip;
+				draw(f->getSheet(), x + layout->glyphs[i].x, y + layout->glyphs[i].y, &clip);
+			}
+		}
+
+		// same as drawText, except the text is rendered to its own surface, kept under label and reused
+		// until the text changes; the better choice for HUD text that stays the same for many frames
+		void drawStaticText(std::string label, std::string font, std::string text, int x, int y)
+		{
+			SDL_Surface* s = fontMan->getStaticText(label, font, text);
+			if(s != NULL)
+				draw(s, x, y);
+		}
+
+		// shows what the engine has allocated (see MemoryTracker.h) every frames frames: printed to stdout, or
+		// drawn in the top left corner with font if one is given; 0 frames turns it off
+		void setMemoryHUD(int frames, std::string font = "")
+		{
+			memHUDInterval = frames;
+			memHUDFont = font;
+			memHUDFrames = 0;
+			memHUDText = MemoryTracker::summary();
+		}
+
 
 	protected:
 		GameManager* gameMan; // Manager of the game and its logic
 		SpriteManager* spriteMan; // Manager of game images
+		FontManager* fontMan; // Manager of bitmap fonts, which get their glyph sheets from spriteMan
+		AudioManager* audioMan; // Manager of sounds, e.g. "audioMan->play("files/jump.wav");"
 
 		int screenWidth, screenHeight,  screenX, screenY;
 		int gameState, framesPerSecond;
@@ -136,6 +350,20 @@ class Game2D
 		SDL_Event event1; // our event listener
 		SDL_Surface* screen; // default screen to which we draw
 
+		RenderPipeline* pipeline; // only exists while running with pipelined rendering on
+		RenderSnapshot* recording; // while pipelined or banded, the frame draw calls are being recorded into
+		bool pipelinedRendering;
+		BandRasterizer* rasterizer; // draws frames in bands across threads, only exists while running with it on
+		RenderSnapshot frame; // the frame being recorded when banded without the pipeline
+		int rasterThreads;
+
+		int memHUDInterval, memHUDFrames; // memory HUD refresh rate (0 = off), frames since the last refresh
+		std::string memHUDFont; // drawn with this, or printed if empty
+		std::string memHUDText;
+
+		std::vector<GameState*> states; // state table, the state numbered i is at i - SPLASHSCREEN
+		int currentState; // state actually running, see getCurrentState
+
 		virtual void initPreScreen()		{} // any initializations that must be done before the screen is created (rarely used)
 		virtual void initPostScreen()		{} // any initializations that must be done after the screen is created
 											// here you'll probably want to override and set up all custom game details here
@@ -150,6 +378,8 @@ class Game2D
 		} 
 										
 		virtual void updateGamePaused()		{} //game behavior when gameState == GAMEPAUSED; ignore if no pause function
+		virtual void updateMenu()			{} //game behavior when gameState == MENU; ignore if no menu
+		virtual void updateCutscene()		{} //game behavior when gameState == CUTSCENE; ignore if no cutscenes
 
 		// by default, polls for an event which sets the listener in action
 		// when an event is confirmed buttonCheck is called, ideally this will check for
@@ -157,7 +387,7 @@ class Game2D
 		//hopefully this will be further abstracted later
 		virtual void checkUserInput()
 		{
-			if(SDL_PollEvent(&event1))
+			if(pollEvent(&event1))
 				{
 					if(event1.type == SDL_QUIT)
 						quit = true;
@@ -166,6 +396,16 @@ class Game2D
 				}
 		}
 
+		// use this instead of SDL_PollEvent (e.g. in a custom checkUserInput): with pipelined rendering the game
+		// runs off the main thread, and events are read on the main thread and handed over
+		bool pollEvent(SDL_Event* e)
+		{
+			if(pipeline != NULL)
+				return pipeline->pollEvent(e);
+
+			return SDL_PollEvent(e);
+		}
+
 		// assuming a currBg has been set (probably in initPostScreen or at any other time during the game)
 		// it should prob be drawn here (by default at 0,0), along with any other objs categorized as backgroundobjs
 		// in many cases this will need to be overridden for custom cases
@@ -178,7 +418,7 @@ class Game2D
 			for(int unsigned i = 0; i < gameMan->getBgObjs()->size(); i++)
 			{
 				GameObj* o = gameMan->getBgObjs()->at(i);
-				Game2D::draw(spriteMan->getImage(o->getImageName()),o->getX(),o->getY());
+				Game2D::draw(o->getImageName(),o->getX(),o->getY());
 			}
 		}
 
@@ -193,7 +433,7 @@ class Game2D
 			for(int unsigned i = 0; i < gameMan->getFgObjs()->size(); i++)
 			{
 				GameObj* o = gameMan->getFgObjs()->at(i);
-				Game2D::draw(spriteMan->getImage(o->getImageName()),o->getX(),o->getY());
+				Game2D::draw(o->getImageName(),o->getX(),o->getY());
 			}
 		}
 
@@ -204,13 +444,13 @@ class Game2D
 			if(gameMan->getPlayer() != NULL)
 			{
 				GameObj* p = gameMan->getPlayer();
-				Game2D::draw(spriteMan->getImage(p->getImageName()),p->getX(),p->getY());
+				Game2D::draw(p->getImageName(),p->getX(),p->getY());
 			}
 
 			for(unsigned int i = 0; i < gameMan->getObjs()->size();i++)
 			{
 				GameObj* temp = gameMan->getObjs()->at(i);
-				Game2D::draw(spriteMan->getImage(temp->getImageName()),temp->getX(),temp->getY());
+				Game2D::draw(temp->getImageName(),temp->getX(),temp->getY());
 			}	
 		}
 
@@ -224,7 +464,38 @@ class Game2D
 
 	private:
 		//Contains the main Game Loop
+		// with pipelined rendering the loop runs on a simulation thread, while this (main) thread reads events
+		// and draws the frames it records; if that thread can't be started it all stays on this thread
 		void run()
+		{
+			if(rasterThreads > 1)
+				rasterizer = new BandRasterizer(rasterThreads);
+
+			bool simulated = false;
+			if(pipelinedRendering)
+			{
+				pipeline = new RenderPipeline();
+				pipeline->setRasterizer(rasterizer);
+				simulated = pipeline->run(screen, simulationThread, this);
+				delete pipeline;
+				pipeline = NULL;
+			}
+
+			if(!simulated)
+				simulate();
+
+			delete rasterizer;
+			rasterizer = NULL;
+		}
+
+		static int simulationThread(void* data)
+		{
+			((Game2D*)data)->simulate();
+			return 0;
+		}
+
+		// the game loop itself: input, update, record or draw the frame
+		void simulate()
 		{
 			FPSManager* fpsMan = new FPSManager();
 
@@ -233,23 +504,118 @@ class Game2D
 				checkUserInput();
 
 				fpsMan->start(); // deal with frame timing issues
+				if(pipeline != NULL)
+					pipeline->markFrameStart();
+
+				updateStateChange(); // frame boundary, the only place the current state changes
+				gameMan->beginFrame();
 
-				if(gameState == STARTSCREEN)
-					updateStartScreen();
-				if(gameState == INGAME)
-					updateInGame();
-				if(gameState == PAUSED)
-					updateGamePaused();
-				if(gameState == GAMEOVER)
-					updateGameOver();
+				GameState* state = getState(currentState);
+				if(state != NULL)
+					state->update(this);
+
+				gameMan->deliverMessages(); // everything posted this frame
+				updateMemoryHUD();
 		
 				if(!paint()) // draw screen
-					return; // abort upon drawing error
+					break; // abort upon drawing error
 
 				fpsMan->manageTime(framesPerSecond);
 			}
 		}
 
+		// wraps one of the original update methods, so they can sit in the state table like any other state
+		class BuiltInState : public GameState
+		{
+			public:
+				BuiltInState(int s)				{id = s;}
+
+				void update(Game2D* game)
+				{
+					switch(id)
+					{
+						case SPLASHSCREEN:	game->updateSplashScreen();	break;
+						case STARTSCREEN:	game->updateStartScreen();	break;
+						case INGAME:		game->updateInGame();		break;
+						case PAUSED:		game->updateGamePaused();	break;
+						case GAMEOVER:		game->updateGameOver();		break;
+						case MENU:			game->updateMenu();			break;
+						case CUTSCENE:		game->updateCutscene();		break;
+					}
+				}
+
+			private:
+				int id;
+		};
+
+		// brings in any finished background loads, then switches to the requested state if there is one
+		// and its preload images are all in; until then the current state keeps running
+		void updateStateChange()
+		{
+			spriteMan->updateLoads();
+			if(spriteMan->hasReloads()) // only ever while hot reloading
+			{
+				if(pipeline != NULL)
+					pipeline->waitIdle(); // the old images can't be swapped out while the main thread draws them
+				spriteMan->applyReloads();
+				fontMan->refreshSheets(); // a sheet that changed size is a new surface now
+				fontMan->clearStaticTexts(); // may have been rendered from a reloaded glyph sheet
+			}
+
+			if(gameState == currentState)
+				return;
+
+			preloadState(gameState); // in case gameState was set directly rather than through changeState
+			if(reportFailedPreloads(gameState))
+			{
+				gameState = currentState; // it would draw without those images, so stay where we are
+				return;
+			}
+			if(!isStateLoaded(gameState))
+				return;
+
+			GameState* old = getState(currentState);
+			if(old != NULL)
+				old->exit(this);
+
+			currentState = gameState;
+
+			GameState* next = getState(currentState);
+			if(next != NULL)
+				next->enter(this);
+		}
+
+		// draws the current state: the background, objects and foreground (unless the state draws everything
+		// itself), then whatever the state draws on top
+		void drawState()
+		{
+			GameState* state = getState(currentState);
+
+			if(state == NULL || state->drawsScene())
+			{
+				drawBackground();
+				drawGameObjects();
+				drawForeground();
+			}
+
+			if(state != NULL)
+				state->draw(this);
+
+			if(memHUDInterval > 0 && !memHUDFont.empty())
+				drawStaticText("memoryHUD", memHUDFont, memHUDText, 0, 0);
+		}
+
+		void updateMemoryHUD()
+		{
+			if(memHUDInterval <= 0 || ++memHUDFrames < memHUDInterval)
+				return;
+
+			memHUDFrames = 0;
+			memHUDText = MemoryTracker::summary();
+			if(memHUDFont.empty())
+				printf("%s\n", memHUDText.c_str());
+		}
+
 		//initialize screen details
 		bool screenInit()
 		{
@@ -270,6 +636,8 @@ class Game2D
 				js = SDL_JoystickOpen(0);
 			}
 
+			audioMan->open(); // no sound device isn't fatal, sounds just aren't heard
+			audioMan->loadSounds();
 			spriteMan->loadImages();
 			initPostScreen(); // do any initialization work needed now that screen is created
 
@@ -283,6 +651,9 @@ class Game2D
 
 			gameMan = getGameManagerInstance();
 			spriteMan = getSpriteManagerInstance();
+			fontMan = new FontManager(spriteMan);
+			audioMan = new AudioManager();
+			gameMan->setSpriteManager(spriteMan);
 
 			screenWidth = sw;
 			screenHeight = sh;
@@ -296,6 +667,9 @@ class Game2D
 
 			gameState = gs;
 
+			for(int i = SPLASHSCREEN; i <= CUTSCENE; i++)
+				registerState(i, new BuiltInState(i));
+
 			//Assign default Values to variables
 			js = NULL;
 			screen = NULL;
@@ -308,9 +682,32 @@ class Game2D
 		//Called every frame at the end of the run loop to draw the current screen
 		bool paint()
 		{
-			drawBackground();
-			drawGameObjects();
-			drawForeground();
+			if(pipeline != NULL) // record the frame and hand it to the main thread, which does the flip
+			{
+				recording = pipeline->beginFrame();
+				drawState();
+				recording = NULL;
+
+				pipeline->publish();
+				return !pipeline->hasFailed();
+			}
+
+			if(rasterizer != NULL) // record the frame, then draw it in bands
+			{
+				// surfaces released while recording (evicted rotations, re-rendered static text...) may already be
+				// in the frame, so they're held until it's been drawn
+				SurfaceUtils::deferReleases(true);
+
+				frame.clear();
+				recording = &frame;
+				drawState();
+				recording = NULL;
+
+				rasterizer->render(&frame, screen);
+				SurfaceUtils::deferReleases(false); // frees them
+			}
+			else
+				drawState();
 
 			if(SDL_Flip(screen) == -1)
 					return false; // return false upon failure
@@ -11,8 +11,16 @@
 
 #pragma once 
 #include <vector>
+#include <algorithm>
 
 #include "GameObj.h"
+#include "MessageBus.h"
+#include "UpdateScheduler.h"
+#include "SpatialGrid.h"
+#include "Pathfinder.h"
+#include "SpriteManager.h"
+#include "SurfaceUtils.h"
+#include "MemoryTracker.h"
 
 #ifndef GAMEMANAGER_H
 #define GAMEMANAGER_H
@@ -20,6 +28,10 @@
 class GameManager
 {
 	public:
+		// NOTE: the object lists are handed out for reading and drawing; to take an object out, use removeObj
+		// (before deleting it), not erase. The collision layers (and messages, scheduler) keep their own
+		// pointers, so an object erased from these lists directly is still found by firstCollision and the
+		// like until rebuildLayers is called
 		bool isGameOver()						{return gameOver;}
 		std::vector<GameObj*>* getObjs()		{return objs;}
 		std::vector<GameObj*>* getBgObjs()		{return bgObjs;}
@@ -27,9 +39,16 @@ class GameManager
 		GameObj* getPlayer()					{return player;}
 		SDL_Surface* getCurrBg()				{return currBg;}
 		SDL_Surface* getCurrFg()				{return currFg;}
+		std::vector<GameObj*>* getLayer(int i)	{return &layers[i];} // every object with bit i in its collision category
+		MessageBus* getMessageBus()				{return messages;}
+		SpatialGrid* getSpatialGrid()			{return spatial;}
+		Pathfinder* getPathfinder()				{return pathfinder;} // empty until given a grid (resize, loadGrid...)
+		UpdateScheduler* getScheduler()			{return scheduler;} // update stats live here
+		bool isScheduling()						{return scheduling;}
 
 		void setCurrBg(SDL_Surface* bg)			{currBg = bg;}
 		void setCurrFg(SDL_Surface* fg)			{currFg = fg;}
+		void setSpriteManager(SpriteManager* sm){spriteMan = sm;} // done by Game2D, gives access to collision masks
 		
 
 		GameManager()
@@ -41,6 +60,18 @@ class GameManager
 			currBg = NULL;
 			currFg = NULL;
 			player = NULL;
+			spriteMan = NULL;
+			layers = new std::vector<GameObj*>[NUM_COLLISION_LAYERS];
+			messages = new MessageBus();
+			spatial = new SpatialGrid();
+			spatialStale = true;
+			spatialReadOnly = false;
+			pathfinder = new Pathfinder();
+			scheduler = new UpdateScheduler();
+			scheduling = false;
+			customFocus = false;
+
+			MEM_TRACK(MEM_MANAGERS, sizeof(GameManager));
 		}
 
 		virtual ~GameManager()
@@ -54,31 +85,43 @@ class GameManager
 			objs->erase(objs->begin(),objs->end());
 			objs->clear();
 			delete fgObjs;
+			delete[] layers;
+			delete messages;
+			delete spatial;
+			delete pathfinder;
+			delete scheduler;
 			clearBg();
 			clearFg();
+
+			MEM_UNTRACK(MEM_MANAGERS, sizeof(GameManager));
 		}
 
 		void setPlayer(GameObj* o)
 		{
 			if(player == NULL)
+			{
 				player = o;
+				addToLayers(o);
+			}
 		}
 
 		void clearPlayer()
 		{
+			removeFromLayers(player);
+			messages->unsubscribeAll(player);
 			delete player;
 			player = NULL;
 		}
 
 		void clearBg()
 		{
-			SDL_FreeSurface(currBg);
+			SurfaceUtils::releaseSurface(currBg);
 			currBg = NULL;
 		}
 
 		void clearFg()
 		{
-			SDL_FreeSurface(currFg);
+			SurfaceUtils::releaseSurface(currFg);
 			currFg = NULL;
 		}
 
@@ -86,18 +129,218 @@ class GameManager
 		void addObj(GameObj* o)
 		{
 			objs->push_back(o);
+			addToLayers(o);
+
+			if(scheduling)
+				scheduler->add(o);
+		}
+
+		// takes an object (main, background or foreground) out of the game without deleting it, so it stops
+		// being updated, drawn, collided with and messaged; required before deleting an object that's in the
+		// game. With scheduling on it's safe to call from inside an update (without it, the object after o in
+		// the list misses that frame's update)
+		void removeObj(GameObj* o)
+		{
+			objs->erase(std::remove(objs->begin(), objs->end(), o), objs->end());
+			bgObjs->erase(std::remove(bgObjs->begin(), bgObjs->end(), o), bgObjs->end());
+			fgObjs->erase(std::remove(fgObjs->begin(), fgObjs->end(), o), fgObjs->end());
+			removeFromLayers(o);
+			messages->unsubscribeAll(o);
+			scheduler->remove(o);
+			invalidateSpatial();
 		}
 
 		// add a background object
 		void addBgObj(GameObj* o)
 		{
 			bgObjs->push_back(o);
+			addToLayers(o);
 		}
 
 		// add a foreground object
 		void addFgObj(GameObj* o)
 		{
 			fgObjs->push_back(o);
+			addToLayers(o);
+		}
+
+		// refills the collision layers from the object lists and the player; only needed by code that has
+		// added or erased objects through getObjs()/getBgObjs()/getFgObjs() directly
+		void rebuildLayers()
+		{
+			for(int l = 0; l < NUM_COLLISION_LAYERS; l++)
+				layers[l].clear();
+
+			for(unsigned int i = 0; i < objs->size(); i++)
+				addToLayers(objs->at(i));
+			for(unsigned int i = 0; i < bgObjs->size(); i++)
+				addToLayers(bgObjs->at(i));
+			for(unsigned int i = 0; i < fgObjs->size(); i++)
+				addToLayers(fgObjs->at(i));
+			if(player != NULL)
+				addToLayers(player);
+		}
+
+		// changes the collision category of an object that has already been added, moving it to its new layers
+		void setCollisionCategory(GameObj* o, Uint32 category)
+		{
+			removeFromLayers(o);
+			o->setCollisionCategory(category);
+			addToLayers(o);
+		}
+
+		// MESSAGES
+		// objects subscribed to a topic get an onMessage call for every message posted to it; posting is safe
+		// from any thread, and everything posted in a frame is delivered together by deliverMessages
+		// NOTE: unsubscribe (or unsubscribeAll) an object before deleting it
+		void subscribe(int topic, GameObj* o)		{messages->subscribe(topic,o);}
+		void unsubscribe(int topic, GameObj* o)		{messages->unsubscribe(topic,o);}
+		void unsubscribeAll(GameObj* o)				{messages->unsubscribeAll(o);}
+
+		// posts a message with a copy of data (plain data only) to topic, e.g. post(HIT, damage, this)
+		template <class T> bool post(int topic, const T& data, GameObj* sender = NULL)
+		{
+			return messages->post(topic,data,sender);
+		}
+
+		bool post(int topic, GameObj* sender = NULL)
+		{
+			return messages->post(topic,sender);
+		}
+
+		// delivers everything posted since the last call; Game2D calls this once a frame after the current
+		// state's update and before drawing. Must not overlap with any posting
+		// sleeping subscribers are woken by their messages
+		virtual void deliverMessages()
+		{
+			messages->deliver(this, scheduler);
+		}
+
+		// UPDATE SCHEDULING
+		// off by default, so every main object is updated every frame. Once on, objects are updated as often
+		// as their tick bucket asks (see GameObj's TICK_...), objects far from the focus are updated less
+		// often still, and sleeping objects aren't updated at all until woken, either by wake, by a message to
+		// a topic they subscribe to, or by something finding them with firstCollision/findCollisions (these
+		// work with scheduling off too, where sleeping objects are simply skipped by update).
+		// Objects updated every few frames should scale what they do per frame by getTickScale().
+		// NOTE: with scheduling on, objects must be added with addObj and taken out with removeObj (not by
+		// editing getObjs() directly). The player is always updated every frame
+		void setScheduling(bool b)
+		{
+			if(b == scheduling)
+				return;
+
+			scheduling = b;
+			for(unsigned int i = 0; i < objs->size(); i++)
+			{
+				if(b)
+					scheduler->add(objs->at(i));
+				else
+					scheduler->remove(objs->at(i));
+			}
+		}
+
+		void sleep(GameObj* o)							{scheduler->sleep(o);}
+		void wake(GameObj* o)							{scheduler->wake(o);}
+		void setTickBucket(GameObj* o, int bucket)		{scheduler->setBucket(o,bucket);}
+
+		// objects further than nearDist (in pixels, along either axis) from the focus are updated at most
+		// every 2nd frame, further than farDist at most every 8th; farDist <= 0 turns this off
+		void setLOD(int nearDist, int farDist)			{scheduler->setLOD(nearDist,farDist);}
+
+		// where distances are measured from, e.g. the middle of the screen for a scrolling game;
+		// until this is called it's wherever the player is
+		void setLODFocus(int x, int y)
+		{
+			customFocus = true;
+			scheduler->setFocus(x,y);
+		}
+
+		// SPATIAL QUERIES
+		// these search every object (main, background, foreground and the player) by position, using a grid
+		// instead of walking the object lists. The grid is brought up to date by the first query of each frame
+		// (Game2D marks it stale once a frame), so every query in a frame shares one refresh; objects moved
+		// after that are found where they were. Call refreshSpatial to force it.
+		// layerMask limits results to objects in those collision categories, ignore is never reported (e.g. the
+		// object asking)
+
+		// adds every object within radius of (x,y) to out, returns how many
+		int queryRadius(float x, float y, float radius, std::vector<GameObj*>* out, Uint32 layerMask = LAYER_ALL, GameObj* ignore = NULL)
+		{
+			prepareSpatial();
+			return spatial->queryRadius(x,y,radius,out,layerMask,ignore);
+		}
+
+		// adds every object overlapping the rectangle to out, returns how many
+		int queryRect(int x, int y, int w, int h, std::vector<GameObj*>* out, Uint32 layerMask = LAYER_ALL, GameObj* ignore = NULL)
+		{
+			prepareSpatial();
+			return spatial->queryRect(x,y,w,h,out,layerMask,ignore);
+		}
+
+		// adds the k objects closest to (x,y) to out, closest first, returns how many (fewer if there aren't k)
+		int nearestK(float x, float y, int k, std::vector<GameObj*>* out, Uint32 layerMask = LAYER_ALL,
+			GameObj* ignore = NULL, float maxDistance = -1)
+		{
+			prepareSpatial();
+			return spatial->nearestK(x,y,k,out,layerMask,ignore,maxDistance);
+		}
+
+		// the closest object to (x,y), or NULL
+		GameObj* nearest(float x, float y, Uint32 layerMask = LAYER_ALL, GameObj* ignore = NULL, float maxDistance = -1)
+		{
+			std::vector<GameObj*> found;
+			nearestK(x,y,1,&found,layerMask,ignore,maxDistance);
+			return found.empty() ? NULL : found[0];
+		}
+
+		// first object the line from (x0,y0) to (x1,y1) runs into, e.g. for line of sight or hitscan weapons
+		bool raycast(float x0, float y0, float x1, float y1, RayHit* hit = NULL, Uint32 layerMask = LAYER_ALL, GameObj* ignore = NULL)
+		{
+			prepareSpatial();
+			return spatial->raycast(x0,y0,x1,y1,hit,layerMask,ignore);
+		}
+
+		// objects have (probably) moved, the next query refreshes the grid
+		void invalidateSpatial()				{spatialStale = true;}
+
+		// called by Game2D at the start of every frame, before the current state's update
+		virtual void beginFrame()
+		{
+			invalidateSpatial();
+			pathfinder->update(); // finished flow fields are picked up here
+		}
+
+		// puts every object in the grid where it is right now
+		virtual void refreshSpatial()
+		{
+			spatial->beginRefresh();
+
+			for(unsigned int i = 0; i < objs->size(); i++)
+				spatial->track(objs->at(i));
+			for(unsigned int i = 0; i < bgObjs->size(); i++)
+				spatial->track(bgObjs->at(i));
+			for(unsigned int i = 0; i < fgObjs->size(); i++)
+				spatial->track(fgObjs->at(i));
+			if(player != NULL)
+				spatial->track(player);
+
+			spatial->endRefresh();
+			spatialStale = false;
+		}
+
+		// queries only read the grid, so objects being updated on several threads can all query at once, as
+		// long as it's between these two calls (which refresh the grid first and then stop queries from doing
+		// it). Call both from the game thread, and don't add or remove objects in between
+		void beginParallelQueries()
+		{
+			prepareSpatial();
+			spatialReadOnly = true;
+		}
+
+		void endParallelQueries()
+		{
+			spatialReadOnly = false;
 		}
 
 		virtual bool checkGameOver() = 0; // checks the status of the game and sets isGameOver appropriately
@@ -110,10 +353,20 @@ class GameManager
 			//NOTE: by default, the background and foreground objects do NOT get calls to their update methods
 			// since they are considered scenery. This will imply no movement/animation, etc
 
-			for(unsigned int i = 0; i < objs->size();i++)
+			if(scheduling)
 			{
-				GameObj* temp = objs->at(i);
-				temp->update(this);
+				if(!customFocus && player != NULL)
+					scheduler->setFocus(player->getX(), player->getY());
+				scheduler->tick(this);
+			}
+			else
+			{
+				for(unsigned int i = 0; i < objs->size();i++)
+				{
+					GameObj* temp = objs->at(i);
+					if(!temp->isAsleep())
+						temp->update(this);
+				}
 			}
 			
 			if(player != NULL)
@@ -122,9 +375,20 @@ class GameManager
 			gameOver = checkGameOver();
 		}
 
+		// returns true if the collision layers of two objects allow them to collide at all
+		static bool canCollide(GameObj* a, GameObj* b)
+		{
+			return (a->getCollisionCategory() & b->getCollisionMask()) != 0 &&
+				(b->getCollisionCategory() & a->getCollisionMask()) != 0;
+		}
+
 		//static function that returns true if two game objs collide
+		// pairs whose collision layers rule each other out are rejected before any hitboxes are looked at
 		static bool collides(GameObj* a, GameObj* b)
 		{
+			if(!canCollide(a,b))
+				return false;
+
 			int ax,ay,aw,ah;
 			int bx, by, bw, bh;
 
@@ -156,6 +420,95 @@ class GameManager
 			return false;
 		}
 
+		// pixel perfect version of collides: the hitboxes are checked first, and only if they overlap are the
+		// sprites' collision masks compared (64 pixels at a time) over the area where the two sprites overlap
+		// objects whose image has no mask are treated as solid, so they fall back to the hitbox result
+		bool pixelCollides(GameObj* a, GameObj* b)
+		{
+			if(!collides(a,b))
+				return false;
+
+			if(spriteMan == NULL)
+				return true;
+
+			CollisionMask* ma = spriteMan->getCollisionMask(a->getImageName());
+			CollisionMask* mb = spriteMan->getCollisionMask(b->getImageName());
+			if(ma == NULL || mb == NULL)
+				return true;
+
+			SDL_Rect ca = a->getClip();
+			SDL_Rect cb = b->getClip();
+
+			// a clip with no size means the whole image is drawn
+			return CollisionMask::overlaps(ma, a->getX(), a->getY(), (ca.w > 0 && ca.h > 0) ? &ca : NULL,
+				mb, b->getX(), b->getY(), (cb.w > 0 && cb.h > 0) ? &cb : NULL);
+		}
+
+		// returns the first object in the given layers (bits) that o collides with, or NULL if there is none
+		// only the lists of those layers are walked, e.g. checking the player against an enemy layer never
+		// looks at bullets or scenery; pixelPerfect uses pixelCollides instead of collides
+		GameObj* firstCollision(GameObj* o, Uint32 layerMask = LAYER_ALL, bool pixelPerfect = false)
+		{
+			layerMask &= o->getCollisionMask();
+
+			for(int l = 0; l < NUM_COLLISION_LAYERS; l++)
+			{
+				if(!(layerMask & (1u << l)))
+					continue;
+
+				for(unsigned int i = 0; i < layers[l].size(); i++)
+				{
+					GameObj* other = layers[l][i];
+					if(other != o && (pixelPerfect ? pixelCollides(o,other) : collides(o,other)))
+					{
+						if(other->isAsleep())
+							scheduler->wake(other); // being run into wakes things up
+						return other;
+					}
+				}
+			}
+
+			return NULL;
+		}
+
+		// returns true if o collides with anything in the given layers
+		bool collidesWithLayer(GameObj* o, Uint32 layerMask, bool pixelPerfect = false)
+		{
+			return firstCollision(o,layerMask,pixelPerfect) != NULL;
+		}
+
+		// adds every object in the given layers that o collides with to out, and returns how many were found
+		// an object in several of the layers is still only reported once
+		int findCollisions(GameObj* o, Uint32 layerMask, std::vector<GameObj*>* out, bool pixelPerfect = false)
+		{
+			int found = 0;
+			layerMask &= o->getCollisionMask();
+
+			for(int l = 0; l < NUM_COLLISION_LAYERS; l++)
+			{
+				Uint32 bit = 1u << l;
+				if(!(layerMask & bit))
+					continue;
+
+				for(unsigned int i = 0; i < layers[l].size(); i++)
+				{
+					GameObj* other = layers[l][i];
+					if(other->getCollisionCategory() & layerMask & (bit - 1))
+						continue; // already visited in an earlier layer
+
+					if(other != o && (pixelPerfect ? pixelCollides(o,other) : collides(o,other)))
+					{
+						if(other->isAsleep())
+							scheduler->wake(other);
+						out->push_back(other);
+						found++;
+					}
+				}
+			}
+
+			return found;
+		}
+
 	protected:
 		bool gameOver;
 		std::vector<GameObj*>* objs; // list of main objects in the game
@@ -164,6 +517,43 @@ class GameManager
 		SDL_Surface* currBg; // current background
 		SDL_Surface* currFg; // current foreground
 		GameObj* player; // seen as "key" object to a game 
+		SpriteManager* spriteMan; // where collision masks come from, NULL if pixel collisions aren't available
+		std::vector<GameObj*>* layers; // one list per collision layer, holding every object in that layer
+		MessageBus* messages;
+		SpatialGrid* spatial; // where every object is, for the spatial queries
+		bool spatialStale; // objects may have moved since the grid was refreshed
+		bool spatialReadOnly; // between beginParallelQueries and endParallelQueries
+		Pathfinder* pathfinder;
+		UpdateScheduler* scheduler; // decides who gets updated when scheduling is on
+		bool scheduling;
+		bool customFocus; // setLODFocus was called, so distances aren't measured from the player
+
+		void prepareSpatial()
+		{
+			if(spatialStale && !spatialReadOnly)
+				refreshSpatial();
+		}
+
+		void addToLayers(GameObj* o)
+		{
+			for(int l = 0; l < NUM_COLLISION_LAYERS; l++)
+			{
+				if(o->getCollisionCategory() & (1u << l))
+					layers[l].push_back(o);
+			}
+		}
+
+		void removeFromLayers(GameObj* o)
+		{
+			if(o == NULL)
+				return;
+
+			for(int l = 0; l < NUM_COLLISION_LAYERS; l++)
+			{
+				if(o->getCollisionCategory() & (1u << l))
+					layers[l].erase(std::remove(layers[l].begin(), layers[l].end(), o), layers[l].end());
+			}
+		}
 
 };
 	// END OF : GAME MANAGER-------------------------
@@ -14,15 +14,42 @@
 
 #pragma once
 
+// the engine uses C++11 atomics and thread_local; every game includes this header early, so this is the one
+// place that says so instead of a page of errors from <atomic> (MSVC doesn't set __cplusplus, so it's checked by version)
+#if defined(_MSC_VER)
+	#if _MSC_VER < 1900
+		#error LPQ2D needs Visual Studio 2015 or newer (C++11 atomics and thread_local)
+	#endif
+#elif __cplusplus < 201103L
+	#error LPQ2D needs C++11: compile with -std=c++11 or newer
+#endif
+
 #include <string>
 #include <vector>
 
 #include "SDL.h"
+#include "MemoryTracker.h"
 
 #ifndef GAMEOBJ_H
 #define GAMEOBJ_H
 
 class GameManager; //forward declaration
+class UpdateScheduler; // UpdateScheduler.h
+struct Message; // MessageBus.h
+
+// COLLISION LAYERS
+// every object belongs to one or more collision categories (bits) and has a mask of the categories it can
+// collide with; two objects are only ever tested against each other if each one's category is in the other's mask
+#define NUM_COLLISION_LAYERS 32
+#define LAYER_DEFAULT 0x00000001 // category objects start in
+#define LAYER_ALL 0xFFFFFFFF // default mask, collides with everything
+
+// TICK BUCKETS
+// how often an object is updated when the game manager's scheduling is on (see UpdateScheduler.h)
+#define TICK_EVERY_FRAME 0
+#define TICK_EVERY_2ND 1
+#define TICK_EVERY_8TH 2
+#define NUM_TICK_BUCKETS 3
 
 //--------------------- STRUCT : HITBOX
 // Basically a rectangle used for collision detection or anything else needed
@@ -50,11 +77,28 @@ class GameObj
 		std::string getImageName()			{return imageName;}
 		SDL_Rect getClip()					{return clip;}
 		std::vector<HitBox>* getHitBoxes()	{return hitboxes;}
+		Uint32 getCollisionCategory()		{return collisionCategory;}
+		Uint32 getCollisionMask()			{return collisionMask;}
+		bool isAsleep()						{return asleep;}
+		int getTickBucket()					{return tickBucket;}
+
+		// how many frames the current update stands for: 1 normally, more for objects updated every few
+		// frames, so per frame amounts (speed, timers...) should be multiplied by it, e.g. incX(speed * getTickScale())
+		int getTickScale()					{return tickScale;}
 
 		void setX(int i)					{x = i;}
 		void setY(int i)					{y = i;}
 		void setImageName(std::string i)	{imageName = i;}
 		void setState(int i)				{state = i;}
+		void setCollisionMask(Uint32 i)		{collisionMask = i;}
+
+		// NOTE: the game manager sorts objects into per layer lists when they're added, so once an object
+		// has been added, change its category through GameManager::setCollisionCategory instead
+		void setCollisionCategory(Uint32 i)	{collisionCategory = i;}
+
+		// NOTE: same goes for these once added: use GameManager::setTickBucket, sleep and wake
+		void setTickBucket(int i)			{tickBucket = i;}
+		void setAsleep(bool b)				{asleep = b;}
 	
 		void incX(int i)					{x += i;}
 		void incY(int i)					{y += i;}
@@ -67,6 +111,8 @@ class GameObj
 		//constructor with all values set, if not provided, state is 0 by default
 		GameObj(int posX, int posY, std::string img, int s = 0)
 		{
+			defaultValues(); // clip, hitbox list and the rest, same as the default constructor
+
 			x = posX;
 			y = posY;
 			imageName = img;
@@ -75,7 +121,7 @@ class GameObj
 
 		virtual ~GameObj()
 		{
-
+			MEM_UNTRACK(MEM_OBJECTS, sizeof(GameObj));
 		}
 
 		//adds a new hit box to this object, will be used sparingly, but useful for objects
@@ -90,6 +136,7 @@ class GameObj
 			h.boxName = name;
 
 			hitboxes->push_back(h);
+			MEM_TRACK(MEM_HITBOXES, sizeof(HitBox));
 		}
 
 		// by default this will return the default hitbox created with the object
@@ -102,6 +149,10 @@ class GameObj
 		//this method should regulate the behavior of the object, whatever that may entail
 		virtual void update(GameManager* gm) = 0;
 
+		// called with every message posted to a topic this object is subscribed to (see GameManager::subscribe)
+		// messages arrive in a batch once a frame, after the update
+		virtual void onMessage(GameManager* gm, const Message* m) {}
+
 	protected:
 		int x, y, state;
 		std::string imageName; // name of image file
@@ -109,6 +160,17 @@ class GameObj
 		std::vector<HitBox>* hitboxes; // a list of an object's hitboxes, most should only have 1
 									// each hitbox has a x,y location relative to the obj, and a width,
 									//height, and name(for identification purposes)
+		Uint32 collisionCategory; // bits of the collision layers this object is in
+		Uint32 collisionMask; // bits of the collision layers this object can collide with
+		bool asleep; // not updated until woken
+		int tickBucket; // how often it asks to be updated (TICK_...)
+		int tickScale; // frames the current update stands for
+
+		// where the scheduler keeps this object
+		friend class UpdateScheduler;
+		bool scheduled;
+		int schedBucket, schedPhase, schedSlot; // bucket it's actually in (after distance demotion), phase, index in that list
+		Uint32 lastTick; // frame it was last updated
 
 	private:
 		void defaultValues()
@@ -116,6 +178,14 @@ class GameObj
 			x = y = state = 0;
 			imageName = "";
 			hitboxes = new std::vector<HitBox>();
+			collisionCategory = LAYER_DEFAULT;
+			collisionMask = LAYER_ALL;
+			asleep = false;
+			tickBucket = TICK_EVERY_FRAME;
+			tickScale = 1;
+			scheduled = false;
+
+			MEM_TRACK(MEM_OBJECTS, sizeof(GameObj));
 
 			clip.x = 0;
 			clip.y = 0;
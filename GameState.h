@@ -0,0 +1,69 @@
+/*GameState.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Base class for the states a game can be in (start screen, in game, paused, a level, a menu...). Game2D
+* keeps a table of states indexed by their number, so each frame the current state's update and draw are
+* called directly instead of going down a chain of ifs.
+*
+* Changing state (Game2D::changeState, or setting gameState like before) never happens in the middle of a
+* frame; the switch is made at the start of the next frame, calling exit on the old state and enter on the
+* new one. Any images a state lists with addPreloadImage start loading in the background as soon as the
+* state is asked for, and the switch waits until they're in, so the new state's first frame doesn't stall.
+*
+* The built in states (STARTSCREEN, INGAME, etc) are registered by Game2D and call its update methods, so
+* games that just override those keep working. Registering a state under one of those numbers replaces it.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#ifndef GAMESTATE_H
+#define GAMESTATE_H
+
+class Game2D; //forward declaration
+
+//------------------------------- CLASS: GAME STATE ----------------------------------
+class GameState
+{
+
+public:
+	std::vector<std::string>* getPreloadImages()	{return &preloadImages;}
+	bool drawsScene()								{return scene;}
+
+	// by default the background, game objects and foreground are drawn before the state's own draw,
+	// which then just adds anything on top (menus, HUD...); turn off for states that draw everything themselves
+	void setDrawsScene(bool b)						{scene = b;}
+
+	GameState()
+	{
+		scene = true;
+	}
+
+	virtual ~GameState()
+	{
+
+	}
+
+	// the game's managers are reached through it (getGameManager, getSpriteManager, getFontManager, getAudioManager)
+	// and drawing goes through its draw/drawText methods
+	virtual void enter(Game2D* game)		{} // called at the start of the first frame in this state
+	virtual void exit(Game2D* game)			{} // called at the start of the first frame in the next state
+	virtual void update(Game2D* game) = 0; // called once a frame while this is the current state
+	virtual void draw(Game2D* game)			{} // called once a frame while this is the current state, after update
+
+	// adds an image (as named in the SpriteManager) to load in the background before this state is entered
+	void addPreloadImage(std::string name)
+	{
+		preloadImages.push_back(name);
+	}
+
+protected:
+	std::vector<std::string> preloadImages;
+	bool scene;
+
+};
+	// END OF: GAME STATE -----------------------------------
+#endif
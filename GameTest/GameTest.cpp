@@ -122,6 +122,8 @@ GTObj::GTObj()
 	getHitBoxes()->at(0).w = 32;
 	getHitBoxes()->at(0).h = 32;
 
+	setCollisionCategory(PLAYER_LAYER);
+
 	//this will sort of be abstracted away in later versions
 }
 
@@ -148,6 +150,8 @@ GTObjDos::GTObjDos()
 	getHitBoxes()->at(0).y = 0;
 	getHitBoxes()->at(0).w = 32;
 	getHitBoxes()->at(0).h = 32;
+
+	setCollisionCategory(ENEMY_LAYER); // the manager files these under the enemy layer when they're added
 }
 
 //-----------------------------------------------------------------
@@ -156,11 +160,6 @@ GTObjDos::GTObjDos()
 bool GTManager::checkGameOver()
 {
 	//let's set the game over condition for when the player and another obj on screen collide
-	for(int unsigned i = 0; i < objs->size(); i ++)
-	{
-		if(collides(player,objs->at(i))) // does a collision check with the player and each of the other 2 faces
-			return true;
-	}
-
-	return false;
+	// only the enemy layer is checked, so this stays cheap no matter what else gets added to the game
+	return collidesWithLayer(player,ENEMY_LAYER);
 }
\ No newline at end of file
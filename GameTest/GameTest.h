@@ -11,6 +11,10 @@
 #ifndef GAMETEST_H
 #define GAMETEST_H
 
+// collision layers used by the test game
+#define PLAYER_LAYER 0x1
+#define ENEMY_LAYER 0x2
+
 class GameTest : public Game2D
 {
 	public:
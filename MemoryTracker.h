@@ -0,0 +1,155 @@
+/*MemoryTracker.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Optional counters of what the engine has allocated, kept per subsystem (tag): how many things are alive,
+* how many bytes they take, the most bytes there have ever been and how many have been made in total.
+* Game2D can show a one line summary while the game runs (see setMemoryHUD), and prints a report of
+* everything still allocated when it shuts down, which is where leaks show up.
+*
+* Off unless the engine is built with LPQ_MEMORY_TRACKING defined (e.g. -DLPQ_MEMORY_TRACKING); without it
+* MEM_TRACK and MEM_UNTRACK compile to nothing. With it, each is a few relaxed atomic adds, cheap enough
+* to leave on for long test runs, and safe from any thread.
+*
+* NOTE: object bytes are the engine's part of an object (sizeof GameObj), not whatever a subclass adds.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdio>
+
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+// TAGS
+#define MEM_OBJECTS 0 // game objects
+#define MEM_HITBOXES 1 // hitboxes added to game objects
+#define MEM_SPRITES 2 // images held by the sprite manager, by surface size
+#define MEM_SURFACES 3 // surfaces the engine renders itself (rotated/scaled sprites, static text)
+#define MEM_MANAGERS 4 // the engine's managers (game, sprite, font, audio, fps)
+#define NUM_MEM_TAGS 5
+
+#ifdef LPQ_MEMORY_TRACKING
+#define MEM_TRACK(tag, bytes) MemoryTracker::allocated(tag, bytes)
+#define MEM_UNTRACK(tag, bytes) MemoryTracker::freed(tag, bytes)
+#else
+#define MEM_TRACK(tag, bytes) ((void)0)
+#define MEM_UNTRACK(tag, bytes) ((void)0)
+#endif
+
+//------------------------------- CLASS: MEMORY TRACKER ----------------------------------
+class MemoryTracker
+{
+
+public:
+	static bool isEnabled()
+	{
+#ifdef LPQ_MEMORY_TRACKING
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	static void allocated(int tag, long bytes)
+	{
+		Counters& c = counters()[tag];
+		c.live.fetch_add(1, std::memory_order_relaxed);
+		c.made.fetch_add(1, std::memory_order_relaxed);
+
+		long now = c.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		long peak = c.peak.load(std::memory_order_relaxed);
+		while(now > peak && !c.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+			;
+	}
+
+	static void freed(int tag, long bytes)
+	{
+		Counters& c = counters()[tag];
+		c.live.fetch_sub(1, std::memory_order_relaxed);
+		c.bytes.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+
+	static long getLive(int tag)		{return counters()[tag].live.load(std::memory_order_relaxed);}
+	static long getBytes(int tag)		{return counters()[tag].bytes.load(std::memory_order_relaxed);}
+	static long getPeakBytes(int tag)	{return counters()[tag].peak.load(std::memory_order_relaxed);}
+	static long getTotalMade(int tag)	{return counters()[tag].made.load(std::memory_order_relaxed);}
+
+	static const char* getTagName(int tag)
+	{
+		static const char* names[NUM_MEM_TAGS] = {"objects", "hitboxes", "sprites", "surfaces", "managers"};
+		return names[tag];
+	}
+
+	// e.g "objects 120 (15K)  hitboxes 120 (5K)  sprites 12 (1.2M)  surfaces 3 (40K)  managers 5 (70K)"
+	static std::string summary()
+	{
+		if(!isEnabled())
+			return "memory tracking off (build with LPQ_MEMORY_TRACKING)";
+
+		std::string s;
+		char buf[64];
+		for(int t = 0; t < NUM_MEM_TAGS; t++)
+		{
+			sprintf(buf, "%s%s %ld (%s)", t > 0 ? "  " : "", getTagName(t), getLive(t), formatBytes(getBytes(t)).c_str());
+			s += buf;
+		}
+
+		return s;
+	}
+
+	// prints everything still allocated to out; Game2D does this once everything it owns is deleted,
+	// so anything listed then was never freed
+	static void report(FILE* out = stdout)
+	{
+		if(!isEnabled())
+			return;
+
+		fprintf(out, "memory report:\n");
+
+		int leaks = 0;
+		for(int t = 0; t < NUM_MEM_TAGS; t++)
+		{
+			fprintf(out, "  %-9s %8ld still allocated, %10s (peak %s, %ld made in total)\n", getTagName(t), getLive(t),
+				formatBytes(getBytes(t)).c_str(), formatBytes(getPeakBytes(t)).c_str(), getTotalMade(t));
+
+			if(getLive(t) != 0)
+				leaks++;
+		}
+
+		if(leaks == 0)
+			fprintf(out, "  nothing leaked\n");
+	}
+
+	// 512 -> "512", 15360 -> "15K", 1258291 -> "1.2M"
+	static std::string formatBytes(long bytes)
+	{
+		char buf[32];
+		if(bytes >= 1024 * 1024 || bytes <= -1024 * 1024)
+			sprintf(buf, "%.1fM", bytes / (1024.0 * 1024.0));
+		else if(bytes >= 1024 || bytes <= -1024)
+			sprintf(buf, "%ldK", bytes / 1024);
+		else
+			sprintf(buf, "%ld", bytes);
+
+		return buf;
+	}
+
+protected:
+	struct Counters
+	{
+		std::atomic<long> live, bytes, peak, made;
+		char pad[64 - 4 * sizeof(std::atomic<long>)]; // tags used from different threads don't share a cache line
+	};
+
+	static Counters* counters()
+	{
+		static Counters c[NUM_MEM_TAGS] = {}; // zeroed before anything can be tracked
+		return c;
+	}
+
+};
+	// END OF: MEMORY TRACKER -----------------------------------
+#endif
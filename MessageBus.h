@@ -0,0 +1,281 @@
+/*MessageBus.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Lets game objects talk to each other without looking each other up. Objects subscribe to topics (plain
+* ints picked by the game), and anything can post a message to a topic, optionally with some data
+* attached. Messages aren't handed out when they're posted; they're collected and delivered in one batch
+* at a fixed point in the frame (by default right after the current state's update, before drawing), by
+* calling onMessage on every object subscribed to the topic.
+*
+* Posting never locks and never calls the heap: the message and its data are bump allocated out of a
+* FrameArena, and pushed onto one of several lock free lists. Each posting thread gets its own list, so
+* parallel update workers can post at the same time without fighting over one. Within a thread, messages
+* arrive in the order they were posted. There are two arenas: messages posted while a batch is being
+* delivered (e.g. from an onMessage) go into the other one and arrive in the next batch.
+*
+* NOTE: posting is thread safe, subscribing and delivering are not; those belong to the game thread and
+* delivering mustn't overlap with any posting. Message data is copied byte for byte and never destructed,
+* so it should be plain data (numbers, pointers, fixed size arrays), not things like std::string.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+#include "FrameArena.h"
+#include "GameObj.h"
+#include "UpdateScheduler.h"
+
+#ifndef MESSAGEBUS_H
+#define MESSAGEBUS_H
+
+#define MAX_MESSAGE_LANES 16 // posting threads past this many share lists (still safe, just contended)
+#define DEFAULT_MESSAGE_ARENA 65536 // bytes of messages per batch before the arena has to grow
+
+//--------------------- STRUCT : MESSAGE
+// header of a posted message, its data (if any) sits right after it in the arena
+struct Message
+{
+	int topic;
+	unsigned int size; // bytes of data attached
+	GameObj* sender; // whoever posted it, may be NULL
+	Message* next; // next message on the same list
+
+	// the attached data, or NULL if there isn't enough of it to be a T
+	template <class T> const T* getData() const
+	{
+		if(size < sizeof(T))
+			return NULL;
+		return (const T*)((const char*)this + headerSize());
+	}
+
+	static size_t headerSize()
+	{
+		return FrameArena::roundUp(sizeof(Message));
+	}
+};
+	//END OF: MESSAGE---------------------
+
+
+//------------------------------- CLASS: MESSAGE BUS ----------------------------------
+class MessageBus
+{
+
+public:
+	int getNumDelivered()				{return delivered;} // messages delivered in the last batch
+	int getNumDropped()					{return dropped;} // messages lost since the last batch because an arena was full
+
+	MessageBus(size_t arenaBytes = DEFAULT_MESSAGE_ARENA)
+	{
+		for(int b = 0; b < 2; b++)
+		{
+			batches[b].arena = new FrameArena(arenaBytes);
+			for(int l = 0; l < MAX_MESSAGE_LANES; l++)
+				batches[b].lanes[l].head = NULL;
+		}
+
+		current = 0;
+		delivered = 0;
+		dropped = 0;
+		droppedSince = 0;
+		delivering = false;
+		unsubscribedWhileDelivering = false;
+	}
+
+	virtual ~MessageBus()
+	{
+		delete batches[0].arena;
+		delete batches[1].arena;
+	}
+
+	// o's onMessage will be called for every message posted to topic (topics are small ints, >= 0)
+	void subscribe(int topic, GameObj* o)
+	{
+		if(topic < 0)
+			return;
+
+		if((unsigned int)topic >= subscribers.size())
+			subscribers.resize(topic + 1);
+
+		std::vector<GameObj*>* subs = &subscribers[topic];
+		if(std::find(subs->begin(), subs->end(), o) == subs->end())
+			subs->push_back(o);
+	}
+
+	void unsubscribe(int topic, GameObj* o)
+	{
+		if(topic < 0 || (unsigned int)topic >= subscribers.size())
+			return;
+
+		std::vector<GameObj*>* subs = &subscribers[topic];
+		if(delivering) // blanked rather than erased, so the delivery loop doesn't skip anyone; cleaned up after
+		{
+			std::replace(subs->begin(), subs->end(), o, (GameObj*)NULL);
+			unsubscribedWhileDelivering = true;
+		}
+		else
+			subs->erase(std::remove(subs->begin(), subs->end(), o), subs->end());
+	}
+
+	// removes o from every topic; must be done before an object that has subscribed is deleted
+	void unsubscribeAll(GameObj* o)
+	{
+		for(unsigned int t = 0; t < subscribers.size(); t++)
+			unsubscribe(t, o);
+	}
+
+	// posts a message with a copy of data attached; returns false if it had to be dropped (arena full)
+	template <class T> bool post(int topic, const T& data, GameObj* sender = NULL)
+	{
+		Batch* batch = &batches[current.load(std::memory_order_acquire)];
+		Message* m = allocMessage(batch, topic, sizeof(T), sender);
+		if(m == NULL)
+			return false;
+
+		new ((char*)m + Message::headerSize()) T(data);
+		push(batch, m);
+
+		return true;
+	}
+
+	// posts a message with no data
+	bool post(int topic, GameObj* sender = NULL)
+	{
+		Batch* batch = &batches[current.load(std::memory_order_acquire)];
+		Message* m = allocMessage(batch, topic, 0, sender);
+		if(m == NULL)
+			return false;
+
+		push(batch, m);
+
+		return true;
+	}
+
+	// hands every message posted since the last batch to the objects subscribed to its topic
+	// messages posted while this runs go into the next batch
+	// sleepers is where sleeping subscribers get woken, before their onMessage (which can put them back to sleep)
+	void deliver(GameManager* gm, UpdateScheduler* sleepers = NULL)
+	{
+		int b = current.load(std::memory_order_relaxed);
+		current.store(1 - b, std::memory_order_release);
+		Batch* batch = &batches[b];
+
+		delivered = 0;
+		dropped = droppedSince.exchange(0);
+		delivering = true;
+
+		for(int l = 0; l < MAX_MESSAGE_LANES; l++)
+		{
+			// lists are pushed onto at the front, so flip them back into the order they were posted in
+			Message* m = batch->lanes[l].head.exchange(NULL, std::memory_order_acquire);
+			Message* ordered = NULL;
+			while(m != NULL)
+			{
+				Message* next = m->next;
+				m->next = ordered;
+				ordered = m;
+				m = next;
+			}
+
+			for(m = ordered; m != NULL; m = m->next)
+			{
+				if(m->topic >= 0 && (unsigned int)m->topic < subscribers.size())
+				{
+					// looked up again for every subscriber, handlers may (un)subscribe while this runs, and subscribing
+					// can move the lists around
+					for(unsigned int i = 0; i < subscribers[m->topic].size(); i++)
+					{
+						GameObj* o = subscribers[m->topic][i];
+						if(o == NULL)
+							continue; // unsubscribed during this delivery
+
+						if(sleepers != NULL && o->isAsleep())
+							sleepers->wake(o);
+						o->onMessage(gm, m);
+					}
+				}
+
+				delivered++;
+			}
+		}
+
+		delivering = false;
+		if(unsubscribedWhileDelivering)
+		{
+			for(unsigned int t = 0; t < subscribers.size(); t++)
+				subscribers[t].erase(std::remove(subscribers[t].begin(), subscribers[t].end(), (GameObj*)NULL), subscribers[t].end());
+			unsubscribedWhileDelivering = false;
+		}
+
+		batch->arena->reset();
+	}
+
+protected:
+	struct Lane
+	{
+		std::atomic<Message*> head; // most recently posted message
+		char pad[64 - sizeof(std::atomic<Message*>)]; // keeps each list on its own cache line
+	};
+
+	struct Batch
+	{
+		FrameArena* arena;
+		Lane lanes[MAX_MESSAGE_LANES];
+	};
+
+	Batch batches[2];
+	std::atomic<int> current; // batch messages are posted into
+	std::vector< std::vector<GameObj*> > subscribers; // indexed by topic
+	bool delivering; // inside deliver, unsubscribed objects are only blanked out of the lists
+	bool unsubscribedWhileDelivering;
+
+	int delivered, dropped;
+	std::atomic<int> droppedSince;
+
+	Message* allocMessage(Batch* batch, int topic, unsigned int size, GameObj* sender)
+	{
+		Message* m = (Message*)batch->arena->alloc(Message::headerSize() + size);
+		if(m == NULL)
+		{
+			droppedSince++;
+			return NULL;
+		}
+
+		m->topic = topic;
+		m->size = size;
+		m->sender = sender;
+
+		return m;
+	}
+
+	// pushes onto the front of the calling thread's list
+	void push(Batch* batch, Message* m)
+	{
+		std::atomic<Message*>* head = &batch->lanes[laneIndex()].head;
+
+		Message* old = head->load(std::memory_order_relaxed);
+		do
+		{
+			m->next = old;
+		} while(!head->compare_exchange_weak(old, m, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	// each thread is given a list the first time it posts, the same one for every bus
+	static int laneIndex()
+	{
+		static std::atomic<int> nextLane(0);
+		static thread_local int lane = -1;
+
+		if(lane < 0)
+			lane = nextLane.fetch_add(1) % MAX_MESSAGE_LANES;
+
+		return lane;
+	}
+
+};
+	// END OF: MESSAGE BUS -----------------------------------
+#endif
@@ -0,0 +1,696 @@
+/*Pathfinder.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Finds ways around a walkability grid: the level cut into square cells, each either walkable or blocked.
+* The grid can be filled in from the hitboxes of objects (usually the background objects, i.e walls), from
+* a text file, or cell by cell. Moves go to any of the 8 neighbouring cells, but never diagonally past the
+* corner of a blocked cell.
+*
+* There are two ways to use it:
+* - findPath: plain A* for a single agent. The per cell bookkeeping and the open list are kept between
+*   searches (and only ever grow), so a search doesn't allocate anything once the first few have run.
+* - getFlowField: for lots of agents heading to the same place (e.g. a swarm chasing the player). One pass
+*   of Dijkstra out from the target gives every cell the direction to step in, then each agent just looks
+*   up the cell it's in. Fields are computed on a worker thread and cached by target cell; until a field is
+*   ready, isReady is false. When the grid changes, only fields the change could matter to (ones that
+*   reach the changed cell) are recomputed, and they keep giving their old directions until then.
+*
+* Everything except the flow field computation itself happens on the game thread. update (called by
+* GameManager once a frame) picks up finished fields and hands out new work.
+*
+* Format of a grid file: the first line is the cell size in pixels, then one line per row of cells with
+* '#' for blocked and anything else (e.g '.') for walkable, then END.
+*/
+
+#pragma once
+
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "GameObj.h"
+
+#ifndef PATHFINDER_H
+#define PATHFINDER_H
+
+#define DEFAULT_PATH_CELL 32 // pixels
+#define MAX_FLOW_FIELDS 16 // fields kept once they stop being asked for
+#define FLOW_FIELD_EXPIRY 120 // frames a field can go unused before it may be dropped
+#define PATH_UNREACHABLE INT_MAX
+
+// cost of a straight and a diagonal step
+#define PATH_STRAIGHT 10
+#define PATH_DIAGONAL 14
+
+//--------------------- STRUCT : PATH POINT
+struct PathPoint
+{
+	int x, y; // center of a cell, in pixels
+};
+	//END OF: PATH POINT---------------------
+
+
+//------------------------------- CLASS: FLOW FIELD ----------------------------------
+// for every cell, which way to step to get to the target cell the fastest
+class FlowField
+{
+
+public:
+	bool isReady()						{return ready;} // false until the first computation finishes
+	int getTargetCell()					{return target;}
+
+	FlowField(int targetCell, int c, int r, int cell)
+	{
+		target = targetCell;
+		cols = c;
+		rows = r;
+		cellSize = cell;
+		ready = false;
+		dirty = true;
+		pending = false;
+		job = 0;
+		lastUsed = 0;
+	}
+
+	virtual ~FlowField()
+	{
+
+	}
+
+	// the step to take from pixel (x,y): dx and dy are each -1, 0 or 1
+	// returns false if the target can't be reached from there (or the field isn't ready, or that's the target)
+	bool getDirection(int x, int y, int* dx, int* dy)
+	{
+		int i = cellAt(x, y);
+		if(i < 0 || !ready || dir[i] < 0)
+			return false;
+
+		*dx = stepX(dir[i]);
+		*dy = stepY(dir[i]);
+
+		return true;
+	}
+
+	// cost of the way to the target from pixel (x,y), in PATH_STRAIGHT units per cell, or PATH_UNREACHABLE
+	int getDistance(int x, int y)
+	{
+		int i = cellAt(x, y);
+		if(i < 0 || !ready)
+			return PATH_UNREACHABLE;
+
+		return dist[i];
+	}
+
+	static int stepX(int d)				{static const int dx[8] = {1,1,0,-1,-1,-1,0,1}; return dx[d];}
+	static int stepY(int d)				{static const int dy[8] = {0,1,1,1,0,-1,-1,-1}; return dy[d];}
+
+protected:
+	friend class Pathfinder;
+
+	int target, cols, rows, cellSize;
+	std::vector<int> dist; // per cell
+	std::vector<Sint8> dir; // per cell, 0-7 (see stepX/stepY) or -1 for no way (or already there)
+	bool ready; // dist and dir hold a computed field
+	bool dirty; // the grid has changed in a way that matters to this field since it was computed
+	bool pending; // being computed on the worker thread
+	Uint32 job; // number of the computation it's waiting for
+	Uint32 lastUsed; // frame it was last asked for
+
+	int cellAt(int x, int y)
+	{
+		if(x < 0 || y < 0)
+			return -1;
+
+		int cx = x / cellSize, cy = y / cellSize;
+		if(cx >= cols || cy >= rows)
+			return -1;
+
+		return cy * cols + cx;
+	}
+
+};
+	// END OF: FLOW FIELD -----------------------------------
+
+
+//------------------------------- CLASS: PATHFINDER ----------------------------------
+class Pathfinder
+{
+
+public:
+	int getCols()						{return cols;}
+	int getRows()						{return rows;}
+	int getCellSize()					{return cellSize;}
+	int getNumFlowFields()				{return fields.size();}
+
+	Pathfinder()
+	{
+		cols = rows = 0;
+		cellSize = DEFAULT_PATH_CELL;
+		frame = 0;
+		search = 0;
+		nextJob = 0;
+
+		thread = NULL;
+		quit = false;
+		lock = SDL_CreateMutex();
+		wake = SDL_CreateCond();
+	}
+
+	virtual ~Pathfinder()
+	{
+		if(thread != NULL)
+		{
+			SDL_mutexP(lock);
+			quit = true;
+			SDL_CondSignal(wake);
+			SDL_mutexV(lock);
+
+			SDL_WaitThread(thread, NULL);
+		}
+
+		for(unsigned int i = 0; i < todo.size(); i++)
+			delete todo[i];
+		for(unsigned int i = 0; i < done.size(); i++)
+			delete done[i];
+		clearFlowFields();
+
+		SDL_DestroyCond(wake);
+		SDL_DestroyMutex(lock);
+	}
+
+	// GRID
+	// sets the size of the grid (in cells) and makes every cell walkable
+	void resize(int c, int r, int cell = DEFAULT_PATH_CELL)
+	{
+		cols = c > 0 ? c : 0;
+		rows = r > 0 ? r : 0;
+		cellSize = cell > 0 ? cell : DEFAULT_PATH_CELL;
+		walkable.assign(cols * rows, 1);
+
+		clearFlowFields();
+	}
+
+	bool isWalkable(int cx, int cy)
+	{
+		return cx >= 0 && cy >= 0 && cx < cols && cy < rows && walkable[cy * cols + cx];
+	}
+
+	void setWalkable(int cx, int cy, bool w)
+	{
+		if(cx < 0 || cy < 0 || cx >= cols || cy >= rows)
+			return;
+
+		int i = cy * cols + cx;
+		if((walkable[i] != 0) == w)
+			return;
+
+		walkable[i] = w ? 1 : 0;
+		invalidate(cx, cy, w);
+	}
+
+	// blocks every cell the rectangle (in pixels) touches
+	void blockRect(int x, int y, int w, int h)
+	{
+		if(w <= 0 || h <= 0 || x + w <= 0 || y + h <= 0)
+			return;
+
+		int cx0 = std::max(x / cellSize, 0);
+		int cy0 = std::max(y / cellSize, 0);
+		int cx1 = std::min((x + w - 1) / cellSize, cols - 1);
+		int cy1 = std::min((y + h - 1) / cellSize, rows - 1);
+
+		for(int cy = cy0; cy <= cy1; cy++)
+			for(int cx = cx0; cx <= cx1; cx++)
+				setWalkable(cx, cy, false);
+	}
+
+	// blocks every cell covered by a hitbox of one of the objects, e.g. blockObjs(gm->getBgObjs())
+	void blockObjs(std::vector<GameObj*>* objs)
+	{
+		for(unsigned int i = 0; i < objs->size(); i++)
+		{
+			GameObj* o = objs->at(i);
+			std::vector<HitBox>* boxes = o->getHitBoxes();
+			if(boxes == NULL)
+				continue;
+
+			for(unsigned int j = 0; j < boxes->size(); j++)
+			{
+				HitBox* b = &boxes->at(j);
+				blockRect(o->getX() + b->x, o->getY() + b->y, b->w, b->h);
+			}
+		}
+	}
+
+	// replaces the grid with one from a file (format at the top); returns false if it couldn't be read
+	bool loadGrid(std::string file)
+	{
+		std::ifstream in(file.c_str());
+		if(!in)
+			return false;
+
+		int cell = DEFAULT_PATH_CELL;
+		std::vector<std::string> lines;
+		std::string line;
+
+		in >> cell;
+		std::getline(in, line); // rest of the first line
+		while(std::getline(in, line) && line.compare(0, 3, "END") != 0)
+		{
+			if(!line.empty() && line[line.size() - 1] == '\r')
+				line.erase(line.size() - 1);
+			lines.push_back(line);
+		}
+
+		unsigned int width = 0;
+		for(unsigned int i = 0; i < lines.size(); i++)
+			width = std::max(width, (unsigned int)lines[i].size());
+
+		resize(width, lines.size(), cell);
+		for(unsigned int cy = 0; cy < lines.size(); cy++)
+			for(unsigned int cx = 0; cx < lines[cy].size(); cx++)
+				walkable[cy * cols + cx] = lines[cy][cx] == '#' ? 0 : 1;
+
+		return true;
+	}
+
+	// A*
+	// finds the cheapest way from pixel (sx,sy) to pixel (tx,ty), adding the center of every cell along it
+	// (after the starting one) to out; returns false if there is no way
+	bool findPath(int sx, int sy, int tx, int ty, std::vector<PathPoint>* out)
+	{
+		int start = cellAt(sx, sy);
+		int goal = cellAt(tx, ty);
+		if(start < 0 || goal < 0 || !walkable[start] || !walkable[goal])
+			return false;
+
+		// bookkeeping is only valid for cells stamped with this search's number, so nothing has to be cleared
+		if(stamp.size() != walkable.size())
+		{
+			stamp.assign(walkable.size(), 0);
+			cost.resize(walkable.size());
+			parent.resize(walkable.size());
+			closed.resize(walkable.size());
+		}
+		if(++search == 0) // wrapped around, old stamps could look current
+		{
+			std::fill(stamp.begin(), stamp.end(), 0);
+			search = 1;
+		}
+
+		int gx = goal % cols, gy = goal / cols;
+		open.clear();
+
+		visit(start, 0, -1);
+		open.push_back(OpenNode(heuristic(start % cols, start / cols, gx, gy), start));
+
+		while(!open.empty())
+		{
+			std::pop_heap(open.begin(), open.end());
+			int c = open.back().cell;
+			open.pop_back();
+
+			if(closed[c])
+				continue; // a cheaper copy of it was already expanded
+			closed[c] = true;
+
+			if(c == goal)
+			{
+				writePath(start, goal, out);
+				return true;
+			}
+
+			int cx = c % cols, cy = c / cols;
+			for(int d = 0; d < 8; d++)
+			{
+				int n = neighbour(&walkable[0], cols, rows, cx, cy, d);
+				if(n < 0)
+					continue;
+
+				int g = cost[c] + ((d & 1) ? PATH_DIAGONAL : PATH_STRAIGHT);
+				if(stamp[n] == search && (closed[n] || g >= cost[n]))
+					continue;
+
+				visit(n, g, c);
+				open.push_back(OpenNode(g + heuristic(n % cols, n / cols, gx, gy), n));
+				std::push_heap(open.begin(), open.end());
+			}
+		}
+
+		return false;
+	}
+
+	// FLOW FIELDS
+	// the field leading to pixel (tx,ty), or NULL if that's outside the grid. A new field starts computing
+	// in the background and isn't ready straight away. Only valid until the next frame, so ask each frame
+	FlowField* getFlowField(int tx, int ty)
+	{
+		int target = cellAt(tx, ty);
+		if(target < 0)
+			return NULL;
+
+		FlowField* f;
+		std::map<int,FlowField*>::iterator it = fields.find(target);
+		if(it != fields.end())
+			f = it->second;
+		else
+		{
+			f = new FlowField(target, cols, rows, cellSize);
+			fields[target] = f;
+		}
+
+		f->lastUsed = frame;
+		if(f->dirty && !f->pending)
+			queueFlow(f);
+
+		return f;
+	}
+
+	int getNumPendingFields()
+	{
+		int n = 0;
+		for(std::map<int,FlowField*>::iterator it = fields.begin(); it != fields.end(); it++)
+			n += it->second->pending ? 1 : 0;
+
+		return n;
+	}
+
+	void clearFlowFields()
+	{
+		for(std::map<int,FlowField*>::iterator it = fields.begin(); it != fields.end(); it++)
+			delete it->second;
+		fields.clear(); // anything still being computed is thrown away when it comes back
+	}
+
+	// once a frame: picks up finished fields, restarts ones the grid has changed under, drops old ones
+	void update()
+	{
+		frame++;
+
+		std::vector<FlowJob*> finished;
+		SDL_mutexP(lock);
+		finished.swap(done);
+		SDL_mutexV(lock);
+
+		for(unsigned int i = 0; i < finished.size(); i++)
+		{
+			FlowJob* j = finished[i];
+			std::map<int,FlowField*>::iterator it = fields.find(j->target);
+
+			// fields cleared or recreated since this was queued don't want it
+			if(it != fields.end() && it->second->pending && it->second->job == j->id)
+			{
+				FlowField* f = it->second;
+				f->dist.swap(j->dist);
+				f->dir.swap(j->dir);
+				f->ready = true;
+				f->pending = false;
+			}
+
+			delete j;
+		}
+
+		for(std::map<int,FlowField*>::iterator it = fields.begin(); it != fields.end(); it++)
+		{
+			if(it->second->dirty && !it->second->pending)
+				queueFlow(it->second);
+		}
+
+		// too many: drop the ones nobody has asked for in a while
+		std::map<int,FlowField*>::iterator it = fields.begin();
+		while((int)fields.size() > MAX_FLOW_FIELDS && it != fields.end())
+		{
+			FlowField* f = it->second;
+			if(frame - f->lastUsed > FLOW_FIELD_EXPIRY && !f->pending)
+			{
+				delete f;
+				fields.erase(it++);
+			}
+			else
+				it++;
+		}
+	}
+
+protected:
+	int cols, rows, cellSize;
+	std::vector<Uint8> walkable; // per cell, 1 or 0
+
+	// A* bookkeeping, kept between searches
+	struct OpenNode
+	{
+		int f, cell;
+		OpenNode(int score, int c)		{f = score; cell = c;}
+		bool operator<(const OpenNode& o) const	{return f > o.f;} // so the heap gives the lowest f
+	};
+
+	std::vector<OpenNode> open;
+	std::vector<Uint32> stamp; // search a cell's cost/parent/closed were last set in
+	std::vector<int> cost;
+	std::vector<int> parent;
+	std::vector<bool> closed;
+	Uint32 search;
+
+	// flow fields
+	struct FlowJob
+	{
+		Uint32 id;
+		int target, cols, rows;
+		std::vector<Uint8> walkable; // copy of the grid at the time it was queued
+		std::vector<int> dist;
+		std::vector<Sint8> dir;
+	};
+
+	std::map<int,FlowField*> fields; // by target cell
+	Uint32 frame;
+	Uint32 nextJob;
+
+	SDL_Thread* thread;
+	SDL_mutex* lock; // guards todo, done and quit
+	SDL_cond* wake;
+	bool quit;
+	std::deque<FlowJob*> todo;
+	std::vector<FlowJob*> done;
+
+	int cellAt(int x, int y)
+	{
+		if(x < 0 || y < 0)
+			return -1;
+
+		int cx = x / cellSize, cy = y / cellSize;
+		if(cx >= cols || cy >= rows)
+			return -1;
+
+		return cy * cols + cx;
+	}
+
+	// octile distance, exact for 8 way movement without walls
+	static int heuristic(int x0, int y0, int x1, int y1)
+	{
+		int dx = abs(x1 - x0), dy = abs(y1 - y0);
+		return PATH_STRAIGHT * (dx + dy) + (PATH_DIAGONAL - 2 * PATH_STRAIGHT) * std::min(dx, dy);
+	}
+
+	// the cell one step in direction d from (cx,cy), or -1 if that step isn't allowed
+	static int neighbour(const Uint8* grid, int cols, int rows, int cx, int cy, int d)
+	{
+		int nx = cx + FlowField::stepX(d), ny = cy + FlowField::stepY(d);
+		if(nx < 0 || ny < 0 || nx >= cols || ny >= rows || !grid[ny * cols + nx])
+			return -1;
+
+		// no cutting corners
+		if((d & 1) && (!grid[cy * cols + nx] || !grid[ny * cols + cx]))
+			return -1;
+
+		return ny * cols + nx;
+	}
+
+	void visit(int c, int g, int from)
+	{
+		stamp[c] = search;
+		cost[c] = g;
+		parent[c] = from;
+		closed[c] = false;
+	}
+
+	void writePath(int start, int goal, std::vector<PathPoint>* out)
+	{
+		unsigned int first = out->size();
+
+		for(int c = goal; c != start; c = parent[c])
+		{
+			PathPoint p;
+			p.x = (c % cols) * cellSize + cellSize / 2;
+			p.y = (c / cols) * cellSize + cellSize / 2;
+			out->push_back(p);
+		}
+
+		std::reverse(out->begin() + first, out->end());
+	}
+
+	// a cell changed; marks the fields that could route differently because of it
+	void invalidate(int cx, int cy, bool nowWalkable)
+	{
+		int c = cy * cols + cx;
+
+		for(std::map<int,FlowField*>::iterator it = fields.begin(); it != fields.end(); it++)
+		{
+			FlowField* f = it->second;
+			if(f->dirty || !f->ready || f->pending)
+			{
+				// anything in flight was computed from the old grid, and dist (if any) is older still, so it
+				// can't tell whether this cell matters to the result on its way
+				f->dirty = true;
+				continue;
+			}
+
+			bool matters;
+			if(!nowWalkable)
+				matters = f->dist[c] != PATH_UNREACHABLE; // something went through here
+			else
+			{
+				// a new opening only matters if the field already reaches next to it
+				matters = false;
+				for(int d = 0; d < 8 && !matters; d++)
+				{
+					int nx = cx + FlowField::stepX(d), ny = cy + FlowField::stepY(d);
+					if(nx >= 0 && ny >= 0 && nx < cols && ny < rows)
+						matters = f->dist[ny * cols + nx] != PATH_UNREACHABLE;
+				}
+			}
+
+			if(matters)
+				f->dirty = true;
+		}
+	}
+
+	void queueFlow(FlowField* f)
+	{
+		FlowJob* j = new FlowJob();
+		j->id = ++nextJob;
+		j->target = f->target;
+		j->cols = cols;
+		j->rows = rows;
+		j->walkable = walkable;
+
+		f->dirty = false;
+		f->pending = true;
+		f->job = j->id;
+
+		SDL_mutexP(lock);
+		todo.push_back(j);
+		SDL_CondSignal(wake);
+		SDL_mutexV(lock);
+
+		if(thread == NULL)
+			thread = SDL_CreateThread(workerThread, this);
+	}
+
+	static int workerThread(void* data)
+	{
+		Pathfinder* p = (Pathfinder*)data;
+		p->work();
+		return 0;
+	}
+
+	void work()
+	{
+		SDL_mutexP(lock);
+
+		while(true)
+		{
+			while(todo.empty() && !quit)
+				SDL_CondWait(wake, lock);
+			if(quit)
+				break;
+
+			FlowJob* j = todo.front();
+			todo.pop_front();
+
+			SDL_mutexV(lock); // compute without holding the lock
+			computeFlow(j);
+			SDL_mutexP(lock);
+
+			done.push_back(j);
+		}
+
+		SDL_mutexV(lock);
+	}
+
+	// Dijkstra out from the target, then each cell points at its cheapest neighbour
+	static void computeFlow(FlowJob* j)
+	{
+		int n = j->cols * j->rows;
+		const Uint8* grid = &j->walkable[0];
+		j->dist.assign(n, PATH_UNREACHABLE);
+		j->dir.assign(n, -1);
+
+		if(!grid[j->target])
+			return;
+
+		std::vector<OpenNode> heap;
+		j->dist[j->target] = 0;
+		heap.push_back(OpenNode(0, j->target));
+
+		while(!heap.empty())
+		{
+			std::pop_heap(heap.begin(), heap.end());
+			OpenNode top = heap.back();
+			heap.pop_back();
+
+			int c = top.cell;
+			if(top.f > j->dist[c])
+				continue; // stale entry
+
+			int cx = c % j->cols, cy = c / j->cols;
+			for(int d = 0; d < 8; d++)
+			{
+				// steps are symmetric, so walking out from the target is the same as walking towards it
+				int nb = neighbour(grid, j->cols, j->rows, cx, cy, d);
+				if(nb < 0)
+					continue;
+
+				int g = j->dist[c] + ((d & 1) ? PATH_DIAGONAL : PATH_STRAIGHT);
+				if(g < j->dist[nb])
+				{
+					j->dist[nb] = g;
+					heap.push_back(OpenNode(g, nb));
+					std::push_heap(heap.begin(), heap.end());
+				}
+			}
+		}
+
+		for(int c = 0; c < n; c++)
+		{
+			if(c == j->target || j->dist[c] == PATH_UNREACHABLE)
+				continue;
+
+			// the step that the cheapest way from here starts with
+			int cx = c % j->cols, cy = c / j->cols;
+			int best = PATH_UNREACHABLE;
+			for(int d = 0; d < 8; d++)
+			{
+				int nb = neighbour(grid, j->cols, j->rows, cx, cy, d);
+				if(nb < 0 || j->dist[nb] == PATH_UNREACHABLE)
+					continue;
+
+				int via = j->dist[nb] + ((d & 1) ? PATH_DIAGONAL : PATH_STRAIGHT);
+				if(via < best)
+				{
+					best = via;
+					j->dir[c] = d;
+				}
+			}
+		}
+	}
+
+};
+	// END OF: PATHFINDER -----------------------------------
+#endif
@@ -0,0 +1,194 @@
+/*RLESprite.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Run length encoded version of a colorkeyed sprite. Most sprites are largely the transparent pink
+* (255,0,255), and a regular colorkey blit still has to look at every one of those pixels. An RLESprite
+* is built once from the loaded surface and only stores the opaque runs ("spans") of each row, so
+* drawing it is a memcpy per span and transparent pixels are never touched or even stored.
+*
+* Blitting requires the destination to be in the same pixel format as the sprite was (which is always
+* the case for images loaded by SpriteManager and drawn to the screen, since both use the display format).
+* canBlitTo can be used to check; Game2D falls back to a regular SDL blit when it returns false.
+*
+* The encoded copy is a snapshot of the sprite's pixels. Sprites given per surface alpha (SDL_SetAlpha) or a
+* different color key afterwards aren't drawn from it (canBlitTo says no), but edits to the pixels themselves
+* can't be seen; after changing a loaded sprite's pixels, call SpriteManager::imageChanged to re-encode it.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+
+#include "SDL.h"
+#include "SurfaceUtils.h"
+
+#ifndef RLESPRITE_H
+#define RLESPRITE_H
+
+//------------------------------- CLASS: RLE SPRITE ----------------------------------
+class RLESprite
+{
+
+public:
+	int getW()							{return w;}
+	int getH()							{return h;}
+	int getNumSpans()					{return spans.size();}
+	int getSourceBytes()				{return sourceBytes;} // size of the surface this was built from
+	int getBytesSaved()					{return sourceBytes - getBytes();}
+
+	// builds the spans from a surface, treating its color key (or 255,0,255 if it has none) as transparent
+	RLESprite(SDL_Surface* src)
+	{
+		w = src->w;
+		h = src->h;
+		bpp = src->format->BytesPerPixel;
+		Rmask = src->format->Rmask;
+		Gmask = src->format->Gmask;
+		Bmask = src->format->Bmask;
+		sourceBytes = SurfaceUtils::surfaceBytes(src);
+		source = src;
+
+		Uint32 key = (src->flags & SDL_SRCCOLORKEY) ? src->format->colorkey : SurfaceUtils::mapColorKey(src->format);
+		keyFlag = src->flags & SDL_SRCCOLORKEY;
+		colorKey = src->format->colorkey;
+
+		if(SDL_MUSTLOCK(src))
+			SDL_LockSurface(src);
+
+		rowStart.reserve(h + 1);
+		for(int y = 0; y < h; y++)
+		{
+			rowStart.push_back(spans.size());
+
+			int x = 0;
+			while(x < w)
+			{
+				while(x < w && SurfaceUtils::getPixel(src, x, y) == key) // skip the transparent run
+					x++;
+				if(x == w)
+					break;
+
+				Span span;
+				span.x = x;
+				span.offset = pixels.size();
+
+				while(x < w && SurfaceUtils::getPixel(src, x, y) != key)
+					x++;
+
+				span.len = x - span.x;
+				Uint8* row = (Uint8*)src->pixels + y * src->pitch;
+				pixels.insert(pixels.end(), row + span.x * bpp, row + x * bpp);
+				spans.push_back(span);
+			}
+		}
+		rowStart.push_back(spans.size());
+
+		if(SDL_MUSTLOCK(src))
+			SDL_UnlockSurface(src);
+	}
+
+	virtual ~RLESprite()
+	{
+
+	}
+
+	// bytes taken up by the encoded sprite
+	int getBytes()
+	{
+		return pixels.size() + spans.size() * sizeof(Span) + rowStart.size() * sizeof(int);
+	}
+
+	// true if dst has the pixel layout this sprite was encoded in, and the sprite is still drawn the way it
+	// was encoded (no per surface alpha, same color key)
+	bool canBlitTo(SDL_Surface* dst)
+	{
+		if(source->flags & SDL_SRCALPHA)
+			return false;
+		if((source->flags & SDL_SRCCOLORKEY) != keyFlag || (keyFlag && source->format->colorkey != colorKey))
+			return false;
+
+		return dst->format->BytesPerPixel == bpp && dst->format->Rmask == Rmask &&
+			dst->format->Gmask == Gmask && dst->format->Bmask == Bmask;
+	}
+
+	// draws the sprite to dst at (x,y), equivalent to a colorkey SDL_BlitSurface
+	// srcClip works like the clip passed to Game2D::draw (a piece of the sprite, NULL for all of it)
+	// dstClip limits where on dst can be drawn to, NULL uses dst's own clip rect
+	// spans outside the clipped area are skipped entirely, spans partly inside are trimmed
+	void blit(SDL_Surface* dst, int x, int y, SDL_Rect* srcClip = NULL, SDL_Rect* dstClip = NULL)
+	{
+		int sx0 = 0, sy0 = 0, sx1 = w, sy1 = h;
+		if(srcClip != NULL)
+		{
+			sx0 = maxInt(srcClip->x, 0);
+			sy0 = maxInt(srcClip->y, 0);
+			sx1 = minInt(srcClip->x + srcClip->w, w);
+			sy1 = minInt(srcClip->y + srcClip->h, h);
+			x += sx0 - srcClip->x;
+			y += sy0 - srcClip->y;
+		}
+
+		SDL_Rect* c = (dstClip != NULL) ? dstClip : &dst->clip_rect;
+		int cx0 = maxInt(c->x, 0), cy0 = maxInt(c->y, 0);
+		int cx1 = minInt(c->x + c->w, dst->w), cy1 = minInt(c->y + c->h, dst->h);
+
+		// rows of the sprite that land inside the clip area
+		int firstRow = maxInt(sy0, sy0 + cy0 - y);
+		int lastRow = minInt(sy1, sy0 + cy1 - y);
+		if(firstRow >= lastRow || sx0 >= sx1)
+			return;
+
+		if(SDL_MUSTLOCK(dst))
+			SDL_LockSurface(dst);
+
+		// horizontal limits in sprite space, so each span needs just one intersection
+		int left = maxInt(sx0, sx0 + cx0 - x);
+		int right = minInt(sx1, sx0 + cx1 - x);
+
+		for(int sy = firstRow; sy < lastRow && left < right; sy++)
+		{
+			Uint8* row = (Uint8*)dst->pixels + (y + sy - sy0) * dst->pitch;
+
+			for(int i = rowStart[sy]; i < rowStart[sy + 1]; i++)
+			{
+				Span& span = spans[i];
+				int a = maxInt((int)span.x, left);
+				int b = minInt((int)span.x + (int)span.len, right);
+				if(a >= b)
+					continue;
+
+				memcpy(row + (x + a - sx0) * bpp, &pixels[span.offset + (a - span.x) * bpp], (b - a) * bpp);
+			}
+		}
+
+		if(SDL_MUSTLOCK(dst))
+			SDL_UnlockSurface(dst);
+	}
+
+protected:
+	// a run of opaque pixels in a row
+	struct Span
+	{
+		Uint16 x; // where the run starts
+		Uint16 len; // how many pixels
+		Uint32 offset; // where its pixels start in the pixels array (in bytes)
+	};
+
+	int w, h, bpp;
+	Uint32 Rmask, Gmask, Bmask;
+	int sourceBytes;
+	SDL_Surface* source; // the surface this was built from (owned by the sprite manager)
+	Uint32 keyFlag, colorKey; // source's color key when encoded
+
+	std::vector<int> rowStart; // index of the first span of each row, plus one past the end
+	std::vector<Span> spans;
+	std::vector<Uint8> pixels; // packed pixel data of every span
+
+	static int minInt(int a, int b)		{return a < b ? a : b;}
+	static int maxInt(int a, int b)		{return a > b ? a : b;}
+
+};
+	// END OF: RLE SPRITE -----------------------------------
+#endif
@@ -0,0 +1,267 @@
+/*RasterBench.cpp
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Times BandRasterizer against drawing the same recorded frame one call after another (RenderSnapshot::replay,
+* which is plain SDL_BlitSurface), at 640x480, 1920x1080 and 3840x2160, and checks the two give exactly the
+* same pixels. Nothing is shown on screen; both are drawn to software surfaces.
+* Before that it times RLESprite::blit against SDL_BlitSurface for single sparse colorkeyed sprites, with the
+* memory each RLE copy saves.
+*
+* Usage: RasterBench [threads] (DEFAULT_RASTER_THREADS if not given)
+* Exits with 1 if any size comes out different.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "SDL.h"
+#include "SurfaceUtils.h"
+#include "RLESprite.h"
+#include "RenderSnapshot.h"
+#include "BandRasterizer.h"
+
+#define BENCH_MIN_TIME 500 // ms each way of drawing is timed for, at least
+#define PIXELS_PER_SPRITE 2000 // scene density, so every size is about as busy
+#define RLE_POSITIONS 256 // spots each sprite is drawn at when timing RLE blits, the same for both ways
+
+using namespace std;
+
+// a 32 bit surface in the screen format used throughout, filled with the color key
+SDL_Surface* makeSurface(int w, int h)
+{
+	SDL_Surface* s = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	Uint32 key = SurfaceUtils::mapColorKey(s->format);
+	SDL_FillRect(s, NULL, key);
+	SDL_SetColorKey(s, SDL_SRCCOLORKEY, key);
+
+	return s;
+}
+
+// a filled circle on a transparent square, the shape most sprites roughly have
+SDL_Surface* makeBall(int size, Uint32 color)
+{
+	SDL_Surface* s = makeSurface(size, size);
+	int r = size / 2;
+
+	for(int y = 0; y < size; y++)
+		for(int x = 0; x < size; x++)
+			if((x - r) * (x - r) + (y - r) * (y - r) < r * r)
+				SurfaceUtils::putPixel(s, x, y, color ^ (x * 3 + y * 5)); // not one flat color
+
+	return s;
+}
+
+// same pixels, compared row by row since pitches may have padding
+bool samePixels(SDL_Surface* a, SDL_Surface* b)
+{
+	for(int y = 0; y < a->h; y++)
+		if(memcmp((Uint8*)a->pixels + y * a->pitch, (Uint8*)b->pixels + y * b->pitch, a->w * 4) != 0)
+			return false;
+
+	return true;
+}
+
+// a ring of the given thickness on a transparent square; the thinner it is, the sparser the sprite
+SDL_Surface* makeRing(int size, int thickness, Uint32 color)
+{
+	SDL_Surface* s = makeSurface(size, size);
+	int r = size / 2;
+	int inner = (r - thickness) > 0 ? (r - thickness) * (r - thickness) : 0;
+
+	for(int y = 0; y < size; y++)
+		for(int x = 0; x < size; x++)
+		{
+			int d = (x - r) * (x - r) + (y - r) * (y - r);
+			if(d < r * r && d >= inner)
+				SurfaceUtils::putPixel(s, x, y, color ^ (x * 3 + y * 5));
+		}
+
+	return s;
+}
+
+// draws the sprite at every spot in xs/ys, either through rle or with SDL_BlitSurface
+void drawAt(SDL_Surface* sprite, RLESprite* rle, SDL_Surface* screen, int* xs, int* ys)
+{
+	for(int i = 0; i < RLE_POSITIONS; i++)
+	{
+		if(rle != NULL)
+			rle->blit(screen, xs[i], ys[i]);
+		else
+		{
+			SDL_Rect offset;
+			offset.x = xs[i];
+			offset.y = ys[i];
+			SDL_BlitSurface(sprite, NULL, screen, &offset);
+		}
+	}
+}
+
+// microseconds per blit of one sprite, drawn until BENCH_MIN_TIME has passed
+double timeBlits(SDL_Surface* sprite, RLESprite* rle, SDL_Surface* screen, int* xs, int* ys)
+{
+	int passes = 0;
+	Uint32 start = SDL_GetTicks();
+
+	do
+	{
+		drawAt(sprite, rle, screen, xs, ys);
+		passes++;
+	} while(SDL_GetTicks() - start < BENCH_MIN_TIME);
+
+	return (double)(SDL_GetTicks() - start) * 1000.0 / ((double)passes * RLE_POSITIONS);
+}
+
+// times RLESprite::blit against SDL_BlitSurface for a size x size ring, checks both draw the same; returns false if not
+bool benchRLE(int size, int thickness)
+{
+	SDL_Surface* sprite = makeRing(size, thickness, 0x20A0FF);
+	RLESprite* rle = new RLESprite(sprite);
+
+	int xs[RLE_POSITIONS], ys[RLE_POSITIONS];
+	for(int i = 0; i < RLE_POSITIONS; i++)
+	{
+		xs[i] = rand() % (640 + size) - size / 2; // some partly off screen, so clipping is included
+		ys[i] = rand() % (480 + size) - size / 2;
+	}
+
+	SDL_Surface* serial = SDL_CreateRGBSurface(SDL_SWSURFACE, 640, 480, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	SDL_Surface* encoded = SDL_CreateRGBSurface(SDL_SWSURFACE, 640, 480, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	SDL_FillRect(serial, NULL, 0);
+	SDL_FillRect(encoded, NULL, 0);
+
+	drawAt(sprite, NULL, serial, xs, ys);
+	drawAt(sprite, rle, encoded, xs, ys);
+	bool same = samePixels(serial, encoded);
+
+	double blitTime = timeBlits(sprite, NULL, serial, xs, ys);
+	double rleTime = timeBlits(sprite, rle, encoded, xs, ys);
+
+	printf("%3dx%-3d ring %2d px thick   SDL_BlitSurface %6.2f us   RLE %6.2f us   %.2fx   %6d of %6d bytes saved   %s\n",
+		size, size, thickness, blitTime, rleTime, rleTime > 0 ? blitTime / rleTime : 0.0, rle->getBytesSaved(),
+		rle->getSourceBytes(), same ? "output matches" : "OUTPUT DIFFERS");
+
+	SDL_FreeSurface(serial);
+	SDL_FreeSurface(encoded);
+	delete rle;
+	SDL_FreeSurface(sprite);
+
+	return same;
+}
+
+// runs one way of drawing the frame until BENCH_MIN_TIME has passed, returns ms per frame
+double timeDrawing(RenderSnapshot* frame, SDL_Surface* screen, BandRasterizer* rasterizer)
+{
+	int frames = 0;
+	Uint32 start = SDL_GetTicks();
+
+	do
+	{
+		if(rasterizer != NULL)
+			rasterizer->render(frame, screen);
+		else
+			frame->replay(screen);
+		frames++;
+	} while(SDL_GetTicks() - start < BENCH_MIN_TIME);
+
+	return (double)(SDL_GetTicks() - start) / frames;
+}
+
+// builds a frame for a w by h screen, times it both ways and compares; returns false if they differ
+bool bench(int w, int h, BandRasterizer* rasterizer, SDL_Surface* bg, SDL_Surface** balls, RLESprite** rles, int numBalls)
+{
+	int numSprites = w * h / PIXELS_PER_SPRITE;
+
+	RenderSnapshot frame;
+	frame.add(bg, NULL, 0, 0, NULL); // plain surface, whole screen
+	for(int i = 0; i < numSprites; i++)
+	{
+		int b = rand() % numBalls;
+		int x = rand() % (w + 64) - 32; // some hang off the edges
+		int y = rand() % (h + 64) - 32;
+
+		if(i % 4 == 0) // plain colorkey surfaces, some drawn from a clip
+		{
+			SDL_Rect clip;
+			clip.x = 4;
+			clip.y = 4;
+			clip.w = balls[b]->w - 8;
+			clip.h = balls[b]->h / 2;
+			frame.add(balls[b], NULL, x, y, (i % 8 == 0) ? &clip : NULL);
+		}
+		else
+			frame.add(NULL, rles[b], x, y, NULL);
+	}
+
+	SDL_Surface* serial = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	SDL_Surface* banded = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	SDL_FillRect(serial, NULL, 0);
+	SDL_FillRect(banded, NULL, 0);
+
+	frame.replay(serial);
+	rasterizer->render(&frame, banded);
+	bool same = samePixels(serial, banded);
+	bool wasBanded = rasterizer->wasLastFrameBanded();
+
+	double serialTime = timeDrawing(&frame, serial, NULL);
+	double bandedTime = timeDrawing(&frame, banded, rasterizer);
+
+	printf("%4dx%-4d %5d sprites   serial %7.2f ms   banded (%d threads) %7.2f ms   %.2fx   %s%s\n", w, h, numSprites,
+		serialTime, rasterizer->getNumThreads(), bandedTime, bandedTime > 0 ? serialTime / bandedTime : 0.0,
+		same ? "output matches" : "OUTPUT DIFFERS", wasBanded ? "" : " (not banded, drawn serially)");
+
+	SDL_FreeSurface(serial);
+	SDL_FreeSurface(banded);
+
+	return same;
+}
+
+int main(int argc, char* args[])
+{
+	if(SDL_Init(SDL_INIT_TIMER) == -1)
+		return 1;
+
+	int threads = (argc > 1) ? atoi(args[1]) : DEFAULT_RASTER_THREADS;
+	BandRasterizer* rasterizer = new BandRasterizer(threads);
+
+	srand(2011); // same scenes every run
+
+	bool ok = true;
+	ok = benchRLE(32, 2) && ok;
+	ok = benchRLE(64, 4) && ok;
+	ok = benchRLE(128, 6) && ok;
+	ok = benchRLE(256, 10) && ok;
+	printf("\n");
+
+	const int numBalls = 4;
+	int sizes[numBalls] = {16, 32, 48, 64};
+	Uint32 colors[numBalls] = {0xFFFF00, 0xFF2020, 0x20A0FF, 0x40FF40};
+	SDL_Surface* balls[numBalls];
+	RLESprite* rles[numBalls];
+	for(int i = 0; i < numBalls; i++)
+	{
+		balls[i] = makeBall(sizes[i], colors[i]);
+		rles[i] = new RLESprite(balls[i]);
+	}
+
+	SDL_Surface* bg = makeSurface(3840, 2160);
+	for(int y = 0; y < bg->h; y++)
+		for(int x = 0; x < bg->w; x++)
+			if((x / 32 + y / 32) % 2 == 0) // checkerboard, half see through
+				SurfaceUtils::putPixel(bg, x, y, 0x303030);
+
+	ok = bench(640, 480, rasterizer, bg, balls, rles, numBalls) && ok;
+	ok = bench(1920, 1080, rasterizer, bg, balls, rles, numBalls) && ok;
+	ok = bench(3840, 2160, rasterizer, bg, balls, rles, numBalls) && ok;
+
+	delete rasterizer;
+	for(int i = 0; i < numBalls; i++)
+	{
+		delete rles[i];
+		SDL_FreeSurface(balls[i]);
+	}
+	SDL_FreeSurface(bg);
+	SDL_Quit();
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,296 @@
+/*RenderPipeline.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Pipelined rendering. Normally each frame is update, then draw, then SDL_Flip, all on one thread, so a
+* frame costs the update time plus the draw time. With the pipeline, the game is simulated on a second
+* thread: it records frame N+1 into a RenderSnapshot while the main thread is still drawing frame N from
+* the other one, so a frame only costs whichever of the two is slower.
+*
+* SDL 1.2's video and event functions aren't thread safe, so everything that touches the display (events,
+* drawing to the screen, SDL_Flip) stays on the main thread, the one that set the video mode, and it's the
+* simulation that moves. Events are read on the main thread and queued for the simulation, which gets them
+* through pollEvent instead of SDL_PollEvent.
+*
+* There are exactly two snapshots. The handoff between the threads is two atomic frame counters (how many
+* frames have been published and how many have been drawn), no locks. The simulation is never more than
+* one frame ahead: if the main thread hasn't finished frame N-1 by the time frame N+1 wants its snapshot,
+* beginFrame waits for it. That keeps input to screen latency bounded at one extra frame.
+*
+* NOTE: code running in the simulation (updates, state changes, recording the frame) must not call SDL video
+* or event functions, nor SDL_BlitSurface on a surface that could be in a recorded frame (the main thread
+* may be blitting it at the same time, and SDL blits change their source). Surfaces and RLE sprites
+* referenced by frames still in flight must be freed through SurfaceUtils::releaseSurface/releaseObject
+* (the engine's own code does this).
+*/
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "RenderSnapshot.h"
+#include "BandRasterizer.h"
+#include "SurfaceUtils.h"
+
+#ifndef RENDERPIPELINE_H
+#define RENDERPIPELINE_H
+
+#define PIPELINE_SPIN_WAIT 1000 // times to check for the other thread before sleeping while waiting on it
+#define MAX_QUEUED_EVENTS 256 // events waiting for the simulation; more than this (a stalled game) are dropped
+
+//------------------------------- CLASS: RENDER PIPELINE ----------------------------------
+class RenderPipeline
+{
+
+public:
+	bool isRunning()					{return running;}
+	bool hasFailed()					{return failed;} // true if SDL_Flip failed
+	Uint32 getFramesDrawn()				{return drawn;}
+
+	// timing, in milliseconds, smoothed over recent frames
+	float getSimTime()					{return simTime;} // simulation work per frame (update + recording)
+	float getRenderTime()				{return renderTime.load();} // main thread work per frame (drawing + flip)
+	float getFrameTime()				{return frameTime;} // time between published frames
+	float getWaitTime()					{return waitTime;} // time the simulation spent waiting on the drawing
+
+	// draws frames with a banded rasterizer instead of one blit after another (the pipeline doesn't own it)
+	// must be set before start
+	void setRasterizer(BandRasterizer* r)	{rasterizer = r;}
+
+	RenderPipeline()
+	{
+		screen = NULL;
+		thread = NULL;
+		rasterizer = NULL;
+		simulate = NULL;
+		simData = NULL;
+		eventLock = SDL_CreateMutex();
+		published = 0;
+		drawn = 0;
+		running = false;
+		failed = false;
+		simTime = frameTime = waitTime = 0;
+		renderTime = 0;
+		lastPublish = frameStart = 0;
+	}
+
+	virtual ~RenderPipeline()
+	{
+		SDL_DestroyMutex(eventLock);
+	}
+
+	// runs sim(data) on a new simulation thread, and on this thread (the one that set the video mode) reads
+	// events and draws the frames it publishes to s, until sim returns and its last frame is on screen
+	// returns false without running anything if the thread couldn't be created
+	bool run(SDL_Surface* s, int (*sim)(void*), void* data)
+	{
+		screen = s;
+		simulate = sim;
+		simData = data;
+		published = 0;
+		drawn = 0;
+		failed = false;
+		running = true;
+
+		SurfaceUtils::setReleaseFence(0);
+		SurfaceUtils::deferReleases(true);
+		frameStart = lastPublish = SDL_GetTicks();
+
+		thread = SDL_CreateThread(simulationThread, this);
+		if(thread == NULL)
+		{
+			running = false;
+			SurfaceUtils::deferReleases(false);
+			return false;
+		}
+
+		presentLoop();
+
+		SDL_WaitThread(thread, NULL);
+		thread = NULL;
+		SurfaceUtils::deferReleases(false); // nothing is in flight anymore
+
+		return true;
+	}
+
+	// the simulation's SDL_PollEvent: takes the oldest event read by the main thread, false if there are none
+	bool pollEvent(SDL_Event* e)
+	{
+		SDL_mutexP(eventLock);
+
+		bool got = !events.empty();
+		if(got)
+		{
+			*e = events.front();
+			events.pop_front();
+		}
+
+		SDL_mutexV(eventLock);
+		return got;
+	}
+
+	// called by the simulation once it's ready to record a frame; returns the snapshot to record it into
+	// waits if the main thread is still drawing the frame before the last one
+	RenderSnapshot* beginFrame()
+	{
+		Uint32 frame = published.load(std::memory_order_relaxed);
+		Uint32 waitStart = SDL_GetTicks();
+
+		// this frame's snapshot was last used by frame-2, which must be drawn before it can be overwritten
+		for(int spins = 0; frame >= 2 && drawn.load(std::memory_order_acquire) < frame - 1 && !failed; spins++)
+		{
+			if(spins >= PIPELINE_SPIN_WAIT)
+				SDL_Delay(1);
+		}
+
+		smooth(&waitTime, SDL_GetTicks() - waitStart);
+
+		RenderSnapshot* snapshot = &snapshots[frame % 2];
+		snapshot->clear();
+
+		return snapshot;
+	}
+
+	// hands the frame recorded since beginFrame over to the main thread
+	void publish()
+	{
+		Uint32 frame = published.load(std::memory_order_relaxed);
+		published.store(frame + 1, std::memory_order_release);
+
+		// surfaces released from here on might be drawn in the next frame
+		SurfaceUtils::setReleaseFence(frame + 1);
+		SurfaceUtils::collectReleases(drawn.load(std::memory_order_acquire));
+
+		Uint32 now = SDL_GetTicks();
+		smooth(&simTime, now - frameStart);
+		smooth(&frameTime, now - lastPublish);
+		lastPublish = now;
+	}
+
+	// waits until the main thread has drawn everything handed to it, so nothing it uses is in use
+	// (called from the simulation)
+	void waitIdle()
+	{
+		Uint32 frame = published.load(std::memory_order_relaxed);
+		for(int spins = 0; running && drawn.load(std::memory_order_acquire) < frame && !failed; spins++)
+		{
+			if(spins >= PIPELINE_SPIN_WAIT)
+				SDL_Delay(1);
+		}
+	}
+
+	// marks the start of the simulation's work on a frame (for timing only)
+	void markFrameStart()
+	{
+		frameStart = SDL_GetTicks();
+	}
+
+	// how much faster frames are produced than if updating and drawing ran back to back on one thread
+	// (e.g 1.8 means 80% more frames); only meaningful when the frame rate isn't being capped
+	float getSpeedup()
+	{
+		if(frameTime <= 0)
+			return 1;
+
+		return (simTime + renderTime.load()) / frameTime;
+	}
+
+protected:
+	SDL_Surface* screen;
+	SDL_Thread* thread; // the simulation
+	int (*simulate)(void*);
+	void* simData;
+	BandRasterizer* rasterizer;
+	RenderSnapshot snapshots[2]; // frame n is recorded into snapshots[n % 2]
+
+	std::atomic<Uint32> published; // frames handed to the main thread
+	std::atomic<Uint32> drawn; // frames the main thread has finished (flipped)
+	std::atomic<bool> running; // the simulation hasn't returned yet
+	std::atomic<bool> failed;
+
+	SDL_mutex* eventLock; // guards events
+	std::deque<SDL_Event> events; // read by the main thread, waiting for the simulation
+
+	float simTime, frameTime, waitTime; // only touched by the simulation
+	std::atomic<float> renderTime; // written by the main thread
+	Uint32 lastPublish, frameStart;
+
+	static void smooth(float* avg, Uint32 sample)
+	{
+		*avg = *avg * 0.9f + sample * 0.1f;
+	}
+
+	static int simulationThread(void* data)
+	{
+		RenderPipeline* p = (RenderPipeline*)data;
+		p->simulate(p->simData);
+		p->running.store(false, std::memory_order_release); // after its last publish
+		return 0;
+	}
+
+	// moves every waiting event over to the simulation's queue
+	void pumpEvents()
+	{
+		SDL_Event e;
+		while(SDL_PollEvent(&e))
+		{
+			SDL_mutexP(eventLock);
+			if(events.size() < MAX_QUEUED_EVENTS)
+				events.push_back(e);
+			SDL_mutexV(eventLock);
+		}
+	}
+
+	void presentLoop()
+	{
+		int spins = 0;
+
+		while(true)
+		{
+			bool live = running.load(std::memory_order_acquire); // read first, so a last frame published before stopping is still seen
+			Uint32 frame = drawn.load(std::memory_order_relaxed);
+
+			if(published.load(std::memory_order_acquire) == frame)
+			{
+				if(!live)
+					break; // everything handed over has been drawn
+
+				if(++spins >= PIPELINE_SPIN_WAIT)
+				{
+					SDL_Delay(1);
+					pumpEvents(); // input keeps flowing while the simulation is busy
+				}
+				continue;
+			}
+			spins = 0;
+
+			pumpEvents();
+
+			Uint32 start = SDL_GetTicks();
+
+			drawFrame(&snapshots[frame % 2]);
+			if(SDL_Flip(screen) == -1)
+				failed = true;
+
+			float t = renderTime.load(std::memory_order_relaxed);
+			smooth(&t, SDL_GetTicks() - start);
+			renderTime.store(t, std::memory_order_relaxed);
+			drawn.store(frame + 1, std::memory_order_release);
+		}
+	}
+
+	// draws a recorded frame to the screen; overridable for other ways of drawing it
+	virtual void drawFrame(RenderSnapshot* snapshot)
+	{
+		if(rasterizer != NULL)
+			rasterizer->render(snapshot, screen);
+		else
+			snapshot->replay(screen);
+	}
+
+};
+	// END OF: RENDER PIPELINE -----------------------------------
+#endif
@@ -0,0 +1,103 @@
+/*RenderSnapshot.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* A recorded frame: every draw call made while painting a frame, in order, holding only what's needed
+* to reproduce it (the source surface or RLE sprite, the clip and the position). Recording a frame instead
+* of drawing it straight away lets it be drawn later, or on another thread, without touching the game
+* objects or managers again.
+*
+* Snapshots don't own the surfaces they point at. Anything that frees a surface which may have been drawn
+* recently should go through SurfaceUtils::releaseSurface, which holds on to it until the frame is drawn.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "SDL.h"
+#include "RLESprite.h"
+
+#ifndef RENDERSNAPSHOT_H
+#define RENDERSNAPSHOT_H
+
+//--------------------- STRUCT : DRAW CMD
+// a single recorded draw call
+struct DrawCmd
+{
+	SDL_Surface* src; // surface to blit, used when rle is NULL
+	RLESprite* rle; // run length encoded sprite to draw instead of src
+	SDL_Rect clip; // piece of the source to draw, only used if clipped is true
+	bool clipped;
+	int x; // where on the screen
+	int y;
+};
+	//END OF: DRAW CMD---------------------
+
+//------------------------------- CLASS: RENDER SNAPSHOT ----------------------------------
+class RenderSnapshot
+{
+
+public:
+	std::vector<DrawCmd>* getCmds()		{return &cmds;}
+
+	RenderSnapshot()
+	{
+		cmds.reserve(256);
+	}
+
+	virtual ~RenderSnapshot()
+	{
+
+	}
+
+	// empties the snapshot for recording a new frame; keeps its memory so steady frames don't allocate
+	void clear()
+	{
+		cmds.clear();
+	}
+
+	void add(SDL_Surface* src, RLESprite* rle, int x, int y, SDL_Rect* clip)
+	{
+		if(src == NULL && rle == NULL) // e.g. no background set or an image that failed to load; SDL would draw nothing
+			return;
+
+		DrawCmd c;
+		c.src = src;
+		c.rle = rle;
+		c.x = x;
+		c.y = y;
+		c.clipped = (clip != NULL);
+		if(clip != NULL)
+			c.clip = *clip;
+
+		cmds.push_back(c);
+	}
+
+	// draws every recorded call to dst, in the order they were made
+	void replay(SDL_Surface* dst)
+	{
+		for(unsigned int i = 0; i < cmds.size(); i++)
+		{
+			DrawCmd* c = &cmds[i];
+			SDL_Rect clip = c->clip;
+
+			if(c->rle != NULL)
+				c->rle->blit(dst, c->x, c->y, c->clipped ? &clip : NULL);
+			else
+			{
+				SDL_Rect offset;
+				offset.x = c->x;
+				offset.y = c->y;
+
+				SDL_BlitSurface(c->src, c->clipped ? &clip : NULL, dst, &offset);
+			}
+		}
+	}
+
+protected:
+	std::vector<DrawCmd> cmds;
+
+};
+	// END OF: RENDER SNAPSHOT -----------------------------------
+#endif
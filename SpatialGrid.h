@@ -0,0 +1,550 @@
+/*SpatialGrid.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Answers "what's near here" questions about game objects without looking at every object. The world is
+* cut into square cells, and each object is listed in every cell its bounds (the box around all of its
+* hitboxes) touch. A query then only looks at the objects listed in the cells it covers. Cells are found
+* by hashing their coordinates into a fixed number of buckets, so the world has no size limit and empty
+* areas cost nothing.
+*
+* The grid isn't told when objects move. Instead it's refreshed in one go (beginRefresh, track every
+* object, endRefresh): objects that stayed in the same cells only have their bounds updated, objects that
+* changed cells are moved, new ones are added and ones that weren't tracked this time are dropped (without
+* being looked at, so deleted objects are fine). GameManager does this lazily, at most once a frame.
+*
+* Queries don't change anything, so any number of threads can query at once as long as nobody refreshes.
+*/
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "GameObj.h"
+
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#define DEFAULT_SPATIAL_CELL 64 // pixels, ideally around the size of a typical object
+#define SPATIAL_BUCKETS 4096 // must be a power of two
+
+//--------------------- STRUCT : RAY HIT
+struct RayHit
+{
+	GameObj* obj; // first object hit
+	float x, y; // where the ray entered its bounds
+	float distance; // from the start of the ray
+};
+	//END OF: RAY HIT---------------------
+
+
+//------------------------------- CLASS: SPATIAL GRID ----------------------------------
+class SpatialGrid
+{
+
+public:
+	int getCellSize()					{return cellSize;}
+	int getNumObjs()					{return numObjs;}
+
+	SpatialGrid(int cell = DEFAULT_SPATIAL_CELL)
+	{
+		cellSize = cell > 0 ? cell : DEFAULT_SPATIAL_CELL;
+		buckets.resize(SPATIAL_BUCKETS);
+		refreshCount = 0;
+		numObjs = 0;
+		minCx = minCy = 0;
+		maxCx = maxCy = -1;
+	}
+
+	virtual ~SpatialGrid()
+	{
+
+	}
+
+	// changing the cell size empties the grid, everything is put back by the next refresh
+	void setCellSize(int cell)
+	{
+		if(cell <= 0 || cell == cellSize)
+			return;
+
+		cellSize = cell;
+		clear();
+	}
+
+	void clear()
+	{
+		for(unsigned int i = 0; i < buckets.size(); i++)
+			buckets[i].clear();
+		records.clear();
+		freeRecords.clear();
+		index.clear();
+		numObjs = 0;
+		minCx = minCy = 0;
+		maxCx = maxCy = -1;
+	}
+
+	// REFRESHING
+	void beginRefresh()
+	{
+		refreshCount++;
+	}
+
+	// puts o in the grid where it is now (or keeps it there); must be called for every object on each refresh
+	void track(GameObj* o)
+	{
+		int x0, y0, x1, y1;
+		getBounds(o, &x0, &y0, &x1, &y1);
+
+		std::map<GameObj*,int>::iterator it = index.find(o);
+		if(it == index.end())
+		{
+			int i;
+			if(!freeRecords.empty())
+			{
+				i = freeRecords.back();
+				freeRecords.pop_back();
+			}
+			else
+			{
+				i = records.size();
+				records.push_back(Record());
+			}
+
+			index[o] = i;
+			numObjs++;
+
+			Record* r = &records[i];
+			r->obj = o;
+			setBounds(r, x0, y0, x1, y1);
+			insert(i);
+			r->seen = refreshCount;
+			return;
+		}
+
+		Record* r = &records[it->second];
+		r->seen = refreshCount;
+
+		if(cellOf(x0) == r->cx0 && cellOf(y0) == r->cy0 && cellOf(x1 - 1) == r->cx1 && cellOf(y1 - 1) == r->cy1)
+		{
+			setBounds(r, x0, y0, x1, y1); // same cells, nothing to move
+			return;
+		}
+
+		remove(it->second);
+		setBounds(r, x0, y0, x1, y1);
+		insert(it->second);
+	}
+
+	// drops everything that wasn't tracked since beginRefresh
+	void endRefresh()
+	{
+		minCx = minCy = 0;
+		maxCx = maxCy = -1;
+		bool first = true;
+
+		for(unsigned int i = 0; i < records.size(); i++)
+		{
+			Record* r = &records[i];
+			if(r->obj == NULL)
+				continue;
+
+			if(r->seen != refreshCount)
+			{
+				remove(i);
+				index.erase(r->obj);
+				r->obj = NULL;
+				freeRecords.push_back(i);
+				numObjs--;
+				continue;
+			}
+
+			if(first || r->cx0 < minCx)
+				minCx = r->cx0;
+			if(first || r->cy0 < minCy)
+				minCy = r->cy0;
+			if(first || r->cx1 > maxCx)
+				maxCx = r->cx1;
+			if(first || r->cy1 > maxCy)
+				maxCy = r->cy1;
+			first = false;
+		}
+	}
+
+	// QUERIES
+	// each one only reports objects with a collision category in layerMask, and never reports ignore
+
+	// adds every object whose bounds overlap the rectangle to out; returns how many were found
+	int queryRect(int x, int y, int w, int h, std::vector<GameObj*>* out, Uint32 layerMask = LAYER_ALL, GameObj* ignore = NULL)
+	{
+		return query(x, y, w, h, -1, 0, 0, out, layerMask, ignore);
+	}
+
+	// adds every object whose bounds come within radius of (x,y) to out; returns how many were found
+	int queryRadius(float x, float y, float radius, std::vector<GameObj*>* out, Uint32 layerMask = LAYER_ALL, GameObj* ignore = NULL)
+	{
+		int x0 = (int)floor(x - radius) - 1; // bounds end where the next pixel starts, so one more on this side
+		int y0 = (int)floor(y - radius) - 1;
+		int x1 = (int)floor(x + radius) + 1;
+		int y1 = (int)floor(y + radius) + 1;
+
+		return query(x0, y0, x1 - x0, y1 - y0, radius, x, y, out, layerMask, ignore);
+	}
+
+	// adds the (up to) k objects whose bounds are closest to (x,y) to out, closest first; objects further
+	// than maxDistance are skipped (a negative maxDistance means no limit). Returns how many were found
+	int nearestK(float x, float y, int k, std::vector<GameObj*>* out, Uint32 layerMask = LAYER_ALL,
+		GameObj* ignore = NULL, float maxDistance = -1)
+	{
+		if(k <= 0 || numObjs == 0)
+			return 0;
+
+		std::vector< std::pair<float,GameObj*> > best; // sorted, closest first
+		int pcx = cellOf((int)floor(x));
+		int pcy = cellOf((int)floor(y));
+
+		for(int ring = 0; ; ring++)
+		{
+			// walk the cells exactly ring cells away from the point's cell (a square outline)
+			for(int cy = pcy - ring; cy <= pcy + ring; cy++)
+			{
+				if(cy < minCy || cy > maxCy)
+					continue;
+
+				bool edge = cy == pcy - ring || cy == pcy + ring;
+				int step = edge ? 1 : 2 * ring;
+
+				for(int cx = pcx - ring; cx <= pcx + ring; cx += (step > 0 ? step : 1))
+				{
+					if(cx >= minCx && cx <= maxCx)
+						nearestInCell(cx, cy, x, y, k, &best, layerMask, ignore, maxDistance);
+				}
+			}
+
+			// anything not seen yet is in a cell at least ring whole cells away
+			float reached = (float)ring * cellSize;
+			if((int)best.size() == k && best.back().first <= reached)
+				break;
+			if(maxDistance >= 0 && reached > maxDistance)
+				break;
+			if(pcx - ring <= minCx && pcx + ring >= maxCx && pcy - ring <= minCy && pcy + ring >= maxCy)
+				break; // covered every cell that has anything in it
+		}
+
+		for(unsigned int i = 0; i < best.size(); i++)
+			out->push_back(best[i].second);
+
+		return best.size();
+	}
+
+	// finds the first object whose bounds the line from (x0,y0) to (x1,y1) passes through
+	// returns false if it doesn't hit anything; otherwise fills in hit (if not NULL)
+	bool raycast(float x0, float y0, float x1, float y1, RayHit* hit = NULL, Uint32 layerMask = LAYER_ALL, GameObj* ignore = NULL)
+	{
+		float dx = x1 - x0;
+		float dy = y1 - y0;
+
+		int cx = cellOf((int)floor(x0));
+		int cy = cellOf((int)floor(y0));
+		int endCx = cellOf((int)floor(x1));
+		int endCy = cellOf((int)floor(y1));
+
+		// walk the cells along the line in order (t goes from 0 at the start to 1 at the end)
+		int stepX = dx > 0 ? 1 : -1;
+		int stepY = dy > 0 ? 1 : -1;
+		float tMaxX = dx != 0 ? ((cx + (dx > 0 ? 1 : 0)) * (float)cellSize - x0) / dx : 2;
+		float tMaxY = dy != 0 ? ((cy + (dy > 0 ? 1 : 0)) * (float)cellSize - y0) / dy : 2;
+		float tDeltaX = dx != 0 ? cellSize / fabs(dx) : 2;
+		float tDeltaY = dy != 0 ? cellSize / fabs(dy) : 2;
+
+		int cells = abs(endCx - cx) + abs(endCy - cy) + 1;
+		float bestT = 2;
+		GameObj* bestObj = NULL;
+
+		for(int i = 0; i < cells; i++)
+		{
+			std::vector<int>* bucket = &buckets[hash(cx, cy)];
+			for(unsigned int j = 0; j < bucket->size(); j++)
+			{
+				Record* r = &records[bucket->at(j)];
+				if(r->obj == ignore || !(r->obj->getCollisionCategory() & layerMask))
+					continue;
+
+				float t;
+				if(rayHitsBox(r, x0, y0, dx, dy, &t) && t < bestT)
+				{
+					bestT = t;
+					bestObj = r->obj;
+				}
+			}
+
+			// a hit inside this cell can't be beaten by anything in a later one
+			float exitT = tMaxX < tMaxY ? tMaxX : tMaxY;
+			if(bestObj != NULL && bestT <= exitT)
+				break;
+
+			if(tMaxX < tMaxY)
+			{
+				cx += stepX;
+				tMaxX += tDeltaX;
+			}
+			else
+			{
+				cy += stepY;
+				tMaxY += tDeltaY;
+			}
+		}
+
+		if(bestObj == NULL)
+			return false;
+
+		if(hit != NULL)
+		{
+			hit->obj = bestObj;
+			hit->x = x0 + dx * bestT;
+			hit->y = y0 + dy * bestT;
+			hit->distance = sqrt(dx * dx + dy * dy) * bestT;
+		}
+
+		return true;
+	}
+
+	// the box around all of o's hitboxes, as [x0,x1) by [y0,y1); an object without any sized hitbox is a
+	// single pixel at its position
+	static void getBounds(GameObj* o, int* x0, int* y0, int* x1, int* y1)
+	{
+		*x0 = o->getX();
+		*y0 = o->getY();
+		*x1 = *x0 + 1;
+		*y1 = *y0 + 1;
+
+		std::vector<HitBox>* boxes = o->getHitBoxes();
+		if(boxes == NULL)
+			return;
+
+		bool first = true;
+		for(unsigned int i = 0; i < boxes->size(); i++)
+		{
+			HitBox* b = &boxes->at(i);
+			if(b->w <= 0 || b->h <= 0)
+				continue;
+
+			int bx0 = o->getX() + b->x;
+			int by0 = o->getY() + b->y;
+			int bx1 = bx0 + b->w;
+			int by1 = by0 + b->h;
+
+			if(first || bx0 < *x0)
+				*x0 = bx0;
+			if(first || by0 < *y0)
+				*y0 = by0;
+			if(first || bx1 > *x1)
+				*x1 = bx1;
+			if(first || by1 > *y1)
+				*y1 = by1;
+			first = false;
+		}
+	}
+
+protected:
+	struct Record
+	{
+		GameObj* obj; // NULL if this record is free
+		int x0, y0, x1, y1; // bounds, as of the last refresh
+		int cx0, cy0, cx1, cy1; // cells the bounds cover (inclusive)
+		Uint32 seen; // refresh it was last tracked in
+	};
+
+	int cellSize;
+	std::vector<Record> records;
+	std::vector<int> freeRecords;
+	std::map<GameObj*,int> index; // object -> its record
+	std::vector< std::vector<int> > buckets; // record numbers, by hashed cell
+	Uint32 refreshCount;
+	int numObjs;
+	int minCx, minCy, maxCx, maxCy; // cells that have anything in them lie within these
+
+	// floor(v / cellSize), also for negative v
+	int cellOf(int v)
+	{
+		return v >= 0 ? v / cellSize : -((-v - 1) / cellSize) - 1;
+	}
+
+	static unsigned int hash(int cx, int cy)
+	{
+		return ((unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u) & (SPATIAL_BUCKETS - 1);
+	}
+
+	void setBounds(Record* r, int x0, int y0, int x1, int y1)
+	{
+		r->x0 = x0;
+		r->y0 = y0;
+		r->x1 = x1;
+		r->y1 = y1;
+		r->cx0 = cellOf(x0);
+		r->cy0 = cellOf(y0);
+		r->cx1 = cellOf(x1 - 1);
+		r->cy1 = cellOf(y1 - 1);
+	}
+
+	// lists record i in the buckets of every cell it covers (only once per bucket, even if two of its cells
+	// hash to the same one)
+	void insert(int i)
+	{
+		Record* r = &records[i];
+		for(int cy = r->cy0; cy <= r->cy1; cy++)
+		{
+			for(int cx = r->cx0; cx <= r->cx1; cx++)
+			{
+				std::vector<int>* bucket = &buckets[hash(cx, cy)];
+				if(std::find(bucket->begin(), bucket->end(), i) == bucket->end())
+					bucket->push_back(i);
+			}
+		}
+	}
+
+	void remove(int i)
+	{
+		Record* r = &records[i];
+		for(int cy = r->cy0; cy <= r->cy1; cy++)
+		{
+			for(int cx = r->cx0; cx <= r->cx1; cx++)
+			{
+				std::vector<int>* bucket = &buckets[hash(cx, cy)];
+				std::vector<int>::iterator it = std::find(bucket->begin(), bucket->end(), i);
+				if(it != bucket->end())
+				{
+					*it = bucket->back();
+					bucket->pop_back();
+				}
+			}
+		}
+	}
+
+	// distance from (x,y) to the closest point of a record's bounds
+	static float distanceTo(Record* r, float x, float y)
+	{
+		float dx = r->x0 - x > 0 ? r->x0 - x : (x - r->x1 > 0 ? x - r->x1 : 0);
+		float dy = r->y0 - y > 0 ? r->y0 - y : (y - r->y1 > 0 ? y - r->y1 : 0);
+		return sqrt(dx * dx + dy * dy);
+	}
+
+	// shared by queryRect and queryRadius (radius < 0 means just the rectangle)
+	int query(int x, int y, int w, int h, float radius, float px, float py, std::vector<GameObj*>* out,
+		Uint32 layerMask, GameObj* ignore)
+	{
+		if(w <= 0 || h <= 0)
+			return 0;
+
+		int found = 0;
+		int qcx0 = cellOf(x), qcy0 = cellOf(y);
+		int qcx1 = cellOf(x + w - 1), qcy1 = cellOf(y + h - 1);
+
+		// no need to look at cells nothing is in
+		int cx0 = std::max(qcx0, minCx), cy0 = std::max(qcy0, minCy);
+		int cx1 = std::min(qcx1, maxCx), cy1 = std::min(qcy1, maxCy);
+
+		for(int cy = cy0; cy <= cy1; cy++)
+		{
+			for(int cx = cx0; cx <= cx1; cx++)
+			{
+				std::vector<int>* bucket = &buckets[hash(cx, cy)];
+				for(unsigned int j = 0; j < bucket->size(); j++)
+				{
+					Record* r = &records[bucket->at(j)];
+
+					// an object covering several of the query's cells is only reported from the first of them
+					// (which also skips objects that are only in this bucket because of a hash collision)
+					if(std::max(r->cx0, qcx0) != cx || std::max(r->cy0, qcy0) != cy || r->cx1 < cx || r->cy1 < cy)
+						continue;
+
+					if(r->obj == ignore || !(r->obj->getCollisionCategory() & layerMask))
+						continue;
+					if(r->x0 >= x + w || r->x1 <= x || r->y0 >= y + h || r->y1 <= y)
+						continue;
+					if(radius >= 0 && distanceTo(r, px, py) > radius)
+						continue;
+
+					out->push_back(r->obj);
+					found++;
+				}
+			}
+		}
+
+		return found;
+	}
+
+	// offers the objects in one cell to the sorted list of the k closest found so far
+	void nearestInCell(int cx, int cy, float x, float y, int k, std::vector< std::pair<float,GameObj*> >* best,
+		Uint32 layerMask, GameObj* ignore, float maxDistance)
+	{
+		std::vector<int>* bucket = &buckets[hash(cx, cy)];
+		for(unsigned int j = 0; j < bucket->size(); j++)
+		{
+			Record* r = &records[bucket->at(j)];
+			if(r->obj == ignore || !(r->obj->getCollisionCategory() & layerMask))
+				continue;
+
+			float d = distanceTo(r, x, y);
+			if(maxDistance >= 0 && d > maxDistance)
+				continue;
+			if((int)best->size() == k && d >= best->back().first)
+				continue;
+
+			// objects covering several cells are offered more than once
+			bool listed = false;
+			for(unsigned int i = 0; i < best->size() && !listed; i++)
+				listed = best->at(i).second == r->obj;
+			if(listed)
+				continue;
+
+			std::pair<float,GameObj*> p(d, r->obj);
+			best->insert(std::upper_bound(best->begin(), best->end(), p, closer), p);
+			if((int)best->size() > k)
+				best->pop_back();
+		}
+	}
+
+	static bool closer(const std::pair<float,GameObj*>& a, const std::pair<float,GameObj*>& b)
+	{
+		return a.first < b.first;
+	}
+
+	// slab test of the line (x0,y0) + t*(dx,dy), t in [0,1], against a record's bounds
+	static bool rayHitsBox(Record* r, float x0, float y0, float dx, float dy, float* t)
+	{
+		float tNear = 0, tFar = 1;
+
+		if(!slab(x0, dx, (float)r->x0, (float)r->x1, &tNear, &tFar))
+			return false;
+		if(!slab(y0, dy, (float)r->y0, (float)r->y1, &tNear, &tFar))
+			return false;
+
+		*t = tNear;
+		return true;
+	}
+
+	static bool slab(float start, float d, float lo, float hi, float* tNear, float* tFar)
+	{
+		if(d == 0)
+			return start >= lo && start < hi;
+
+		float t0 = (lo - start) / d;
+		float t1 = (hi - start) / d;
+		if(t0 > t1)
+			std::swap(t0, t1);
+
+		if(t0 > *tNear)
+			*tNear = t0;
+		if(t1 < *tFar)
+			*tFar = t1;
+
+		return *tNear <= *tFar;
+	}
+
+};
+	// END OF: SPATIAL GRID -----------------------------------
+#endif
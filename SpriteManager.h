@@ -4,19 +4,34 @@
 *
 * Class responsible for loading in necessary game images from a text file, and returning an SDL_Surface* of the image when queried
 * for it. By default this file is in files/images.txt
+*
+* With hot reload on (setHotReload), image files are watched while the game runs. When one is saved, just
+* that file is decoded again in the background and swapped in at the start of a frame. Objects refer to
+* images by name, so they pick up the new version on their own; if the new image is the same size as the
+* old one it's copied into the existing surface, so even SDL_Surface pointers held onto (e.g font sheets)
+* stay valid and show the change.
 * 
 */
 
 #pragma once
 
 #include <map>
+#include <set>
 #include <vector>
 #include <fstream>
+#include <cstring>
 
 #include <sstream>
 
 #include "SDL.h"
 #include "SDL_image.h"
+#include "TransformCache.h"
+#include "RLESprite.h"
+#include "CollisionMask.h"
+#include "AsyncLoader.h"
+#include "AssetWatcher.h"
+#include "SurfaceUtils.h"
+#include "MemoryTracker.h"
 
 using namespace std;
 
@@ -29,16 +44,51 @@ class SpriteManager
 
 public:
 	map<string,SDL_Surface*>* getImages()		{return images;}
+	TransformCache* getTransformCache()			{return transforms;}
+	map<string,RLESprite*>* getRLEImages()		{return rleImages;}
+	map<string,CollisionMask*>* getMasks()		{return masks;}
+
+	// whether images get a run length encoded copy when loaded (on by default)
+	// only images where the encoded copy comes out smaller than rleThreshold percent of the surface keep it
+	void setUseRLE(bool b)						{useRLE = b;}
+	void setRLEThreshold(int percent)			{rleThreshold = percent;}
+
+	// whether images get a pixel collision mask generated when loaded (on by default)
+	void setGenerateMasks(bool b)				{generateMasks = b;}
+
+	bool isHotReloading()						{return watcher != NULL;}
+	int getNumReloads()							{return numReloads;} // images swapped in since starting
+	bool hasReloads()							{return !reloads.empty();} // reloaded images waiting for applyReloads
 
 	SpriteManager()
 	{
 		images = new map<string,SDL_Surface*>();
+		rleImages = new map<string,RLESprite*>();
+		masks = new map<string,CollisionMask*>();
+		transforms = new TransformCache();
+		loader = new AsyncLoader();
+		useRLE = true;
+		rleThreshold = 75;
+		generateMasks = true;
+		watcher = NULL;
+		numReloads = 0;
+
+		MEM_TRACK(MEM_MANAGERS, sizeof(SpriteManager));
 	}
 
 	virtual ~SpriteManager()
 	{
+		delete watcher;
+		delete loader; // stop background loading before anything else goes
+		for(unsigned int i = 0; i < reloads.size(); i++)
+			SDL_FreeSurface(reloads[i].second);
 		clearImages();
 		delete images;
+		delete rleImages;
+		delete masks;
+		delete transforms;
+
+		MEM_UNTRACK(MEM_MANAGERS, sizeof(SpriteManager));
 	}
 
 	//when passed in a key (the name of the image), returns that image as an SDL_Surface*
@@ -47,8 +97,264 @@ public:
 		return images->at(key);
 	}
 
+	// returns true if an image has been loaded under this key
+	// NOTE: images in images.txt that couldn't be loaded are kept as NULL, so this is true for them too; see hasFailed
+	bool hasImage(string key)
+	{
+		return images->find(key) != images->end();
+	}
+
+	// returns true if the last attempt to load this image (from images.txt, getOrLoadImage or requestImage)
+	// failed because the file is missing or unreadable
+	bool hasFailed(string key)
+	{
+		return failed.find(key) != failed.end();
+	}
+
+	// forgets that an image failed to load, so the next requestImage tries the file again
+	// (except for images.txt entries, which stay NULL in the manager)
+	void clearFailed(string key)
+	{
+		if(!hasImage(key))
+			failed.erase(key);
+	}
+
+	// like getImage, except an image not in the manager yet is loaded (and kept) on the spot
+	// useful for assets that aren't listed in images.txt, such as font sheets
+	// returns NULL if the file can't be loaded; nothing is stored then, so a later call tries again
+	SDL_Surface* getOrLoadImage(string key)
+	{
+		map<string,SDL_Surface*>::iterator it = images->find(key);
+		if(it != images->end())
+			return it->second;
+
+		SDL_Surface* img = loadImage(key);
+		if(img == NULL)
+		{
+			failed.insert(key);
+			return NULL;
+		}
+
+		failed.erase(key);
+		storeImage(key,img);
+
+		return img;
+	}
+
+	// starts loading an image in the background (if it isn't loaded or loading already); it shows up in the
+	// manager during the first updateLoads after it has been decoded
+	// an image that failed to load isn't tried again until clearFailed, and never ends up in the manager as NULL
+	void requestImage(string key)
+	{
+		if(!hasImage(key) && !hasFailed(key))
+			loader->request(key);
+	}
+
+	// true while an image requested with requestImage is still on its way
+	bool isLoading(string key)
+	{
+		return loader->isPending(key);
+	}
+
+	int getNumLoading()
+	{
+		return loader->getNumPending();
+	}
+
+	// turns watching image files for changes on or off (off by default); best turned on in initPostScreen
+	// or earlier, and only while developing
+	void setHotReload(bool b)
+	{
+		if(!b)
+		{
+			delete watcher;
+			watcher = NULL;
+			return;
+		}
+
+		if(watcher != NULL)
+			return;
+
+		watcher = new AssetWatcher();
+		for(map<string,SDL_Surface*>::iterator it = images->begin(); it != images->end(); it++)
+			watcher->watch(it->first);
+	}
+
+	// adds any images the background loader has finished to the manager, and starts reloading any image
+	// files that changed; called by Game2D once a frame, at the start of the frame
+	// reloaded images are held back until applyReloads, since swapping them can't happen while drawing
+	virtual void updateLoads()
+	{
+		if(watcher != NULL)
+		{
+			changedFiles.clear();
+			watcher->collect(&changedFiles);
+
+			for(unsigned int i = 0; i < changedFiles.size(); i++)
+			{
+				if(hasImage(changedFiles[i]))
+				{
+					reloading.insert(changedFiles[i]);
+					loader->request(changedFiles[i]);
+				}
+			}
+		}
+
+		decoded.clear();
+		loader->collect(&decoded);
+
+		for(unsigned int i = 0; i < decoded.size(); i++)
+		{
+			SDL_Surface* img = optimizeImage(decoded[i].second);
+			if(reloading.erase(decoded[i].first) > 0)
+			{
+				if(img != NULL) // a half saved or broken file keeps the old version
+					reloads.push_back(pair<string,SDL_Surface*>(decoded[i].first,img));
+			}
+			else if(hasImage(decoded[i].first))
+				SDL_FreeSurface(img); // loaded the regular way in the meantime
+			else if(img == NULL)
+				failed.insert(decoded[i].first); // missing or broken file
+			else
+				storeImage(decoded[i].first,img);
+		}
+	}
+
+	// swaps in every image reloaded by updateLoads
+	// nothing may be drawing at the time (with pipelined rendering, Game2D waits for the render thread first)
+	virtual void applyReloads()
+	{
+		for(unsigned int i = 0; i < reloads.size(); i++)
+			replaceImage(reloads[i].first, reloads[i].second);
+		reloads.clear();
+	}
+
+	// puts img in the manager under key in place of whatever image was there, rebuilding everything made
+	// from it (mask, RLE copy, rotations). Same rules as applyReloads about drawing
+	void replaceImage(string key, SDL_Surface* img)
+	{
+		map<string,SDL_Surface*>::iterator it = images->find(key);
+		if(it == images->end())
+		{
+			storeImage(key,img);
+			return;
+		}
+
+		SDL_Surface* old = it->second;
+		if(old != NULL && img != NULL && sameLayout(old,img))
+		{
+			copyPixels(img,old); // anyone holding the old surface sees the new image
+			SDL_FreeSurface(img);
+		}
+		else
+		{
+			it->second = img;
+			if(old != NULL)
+				MEM_UNTRACK(MEM_SPRITES, SurfaceUtils::surfaceBytes(old));
+			if(img != NULL)
+				MEM_TRACK(MEM_SPRITES, SurfaceUtils::surfaceBytes(img));
+			SurfaceUtils::releaseSurface(old);
+		}
+
+		imageChanged(key);
+		numReloads++;
+	}
+
+	// rebuilds everything made from an image (mask, RLE copy, rotations); call after drawing on or otherwise
+	// changing the pixels of a loaded image, since those copies can't tell. Same rules as applyReloads about drawing
+	void imageChanged(string key)
+	{
+		map<string,SDL_Surface*>::iterator it = images->find(key);
+		if(it == images->end())
+			return;
+
+		transforms->invalidate(key);
+
+		map<string,RLESprite*>::iterator r = rleImages->find(key);
+		if(r != rleImages->end())
+		{
+			SurfaceUtils::releaseObject(r->second); // a frame still being drawn may use it
+			rleImages->erase(r);
+		}
+
+		map<string,CollisionMask*>::iterator m = masks->find(key);
+		if(m != masks->end())
+		{
+			delete m->second;
+			masks->erase(m);
+		}
+
+		buildExtras(key,it->second);
+	}
+
+	// returns the run length encoded version of an image, or NULL if it doesn't have one
+	// (RLE turned off, or the image is too solid for it to be worth it)
+	RLESprite* getRLEImage(string key)
+	{
+		map<string,RLESprite*>::iterator it = rleImages->find(key);
+		if(it == rleImages->end())
+			return NULL;
+
+		return it->second;
+	}
+
+	// returns the pixel collision mask of an image, or NULL if it doesn't have one
+	CollisionMask* getCollisionMask(string key)
+	{
+		map<string,CollisionMask*>::iterator it = masks->find(key);
+		if(it == masks->end())
+			return NULL;
+
+		return it->second;
+	}
+
+	// how many bytes the encoded version of an image takes up less than its surface (0 if not encoded)
+	int getRLEBytesSaved(string key)
+	{
+		RLESprite* rle = getRLEImage(key);
+		if(rle == NULL)
+			return 0;
+
+		return rle->getBytesSaved();
+	}
+
+	// same as above, summed over every encoded image
+	int getTotalRLEBytesSaved()
+	{
+		int total = 0;
+		for(map<string,RLESprite*>::iterator it = rleImages->begin(); it != rleImages->end(); it++)
+			total += it->second->getBytesSaved();
+
+		return total;
+	}
+
+	// returns the image rotated by angle degrees (clockwise) and scaled by scale
+	// variants are generated the first time they're asked for and cached after that (see TransformCache.h),
+	// the returned surface belongs to the cache, so it should be drawn right away rather than held onto
+	SDL_Surface* getTransformedImage(string key, double angle, double scale)
+	{
+		return transforms->get(key, getImage(key), angle, scale);
+	}
+
+	// generates all rotations of an image at the given scale ahead of time, so spinning it never stalls
+	// best called in initPostScreen for sprites known to rotate
+	void prewarmTransforms(string key, double scale = 1.0)
+	{
+		transforms->prewarm(key, getImage(key), scale);
+	}
+
 	void clearImages()
 	{
+		transforms->clear();
+
+		for(map<string,RLESprite*>::iterator it = rleImages->begin(); it != rleImages->end(); it++)
+			SurfaceUtils::releaseObject(it->second); // a frame still being drawn may use it
+		rleImages->clear();
+
+		for(map<string,CollisionMask*>::iterator it = masks->begin(); it != masks->end(); it++)
+			delete it->second;
+		masks->clear();
+
 		images->erase(images->begin(),images->end());
 		images->clear();
 	}
@@ -68,7 +374,10 @@ public:
 			if(line == "END")
 				break;
 
-			images->insert(pair<string,SDL_Surface*>(line,loadImage(line)));
+			SDL_Surface* img = loadImage(line);
+			if(img == NULL)
+				failed.insert(line);
+			storeImage(line,img); // kept even if NULL, so getImage doesn't throw for images in the list
 		}
 
 		file.close();
@@ -82,10 +391,26 @@ public:
 			SDL_Surface* returnImg = NULL;
 
 			initImg = IMG_Load(file.c_str());
+			if(initImg == NULL)
+				return NULL; // missing or unreadable file
 	
-			returnImg = SDL_DisplayFormat(initImg);
+			returnImg = optimizeImage(initImg);
+
+			return returnImg;
+		}
+
+	// second half of loadImage: converts a freshly decoded image to the display format and keys it
+	// frees the decoded image; must be called on the game thread
+		static SDL_Surface* optimizeImage(SDL_Surface* initImg)
+		{
+			if(initImg == NULL)
+				return NULL;
+
+			SDL_Surface* returnImg = SDL_DisplayFormat(initImg);
 
 			SDL_FreeSurface(initImg);
+			if(returnImg == NULL)
+				return NULL;
 
 			Uint32 colorkey = SDL_MapRGB(returnImg->format, 0xFF, 0, 0xFF); // Note: color that is being taken as transparent is a pink 
 			SDL_SetColorKey( returnImg, SDL_SRCCOLORKEY, colorkey );											   //which is 255,0,255
@@ -94,7 +419,77 @@ public:
 		}
 
 protected:
+	// adds a freshly loaded image to the manager, building its collision mask and its run length encoded copy
+	// (if worthwhile)
+	void storeImage(string key, SDL_Surface* img)
+	{
+		images->insert(pair<string,SDL_Surface*>(key,img));
+		if(img != NULL)
+			MEM_TRACK(MEM_SPRITES, SurfaceUtils::surfaceBytes(img));
+		if(watcher != NULL)
+			watcher->watch(key);
+
+		buildExtras(key,img);
+	}
+
+	void buildExtras(string key, SDL_Surface* img)
+	{
+		if(img == NULL)
+			return;
+
+		if(generateMasks)
+			masks->insert(pair<string,CollisionMask*>(key,new CollisionMask(img)));
+
+		if(!useRLE || !(img->flags & SDL_SRCCOLORKEY))
+			return;
+
+		RLESprite* rle = new RLESprite(img);
+		if(rle->getBytes() * 100 <= rle->getSourceBytes() * rleThreshold)
+			rleImages->insert(pair<string,RLESprite*>(key,rle));
+		else
+			delete rle;
+	}
+
+	// true if b's pixels can be copied straight over a's
+	static bool sameLayout(SDL_Surface* a, SDL_Surface* b)
+	{
+		return a->w == b->w && a->h == b->h && a->format->BytesPerPixel == b->format->BytesPerPixel &&
+			a->format->Rmask == b->format->Rmask && a->format->Gmask == b->format->Gmask &&
+			a->format->Bmask == b->format->Bmask && a->format->Amask == b->format->Amask;
+	}
+
+	static void copyPixels(SDL_Surface* src, SDL_Surface* dst)
+	{
+		if(SDL_MUSTLOCK(dst))
+			SDL_LockSurface(dst);
+		if(SDL_MUSTLOCK(src))
+			SDL_LockSurface(src);
+
+		int rowBytes = src->w * src->format->BytesPerPixel;
+		for(int y = 0; y < src->h; y++)
+			memcpy((Uint8*)dst->pixels + y * dst->pitch, (Uint8*)src->pixels + y * src->pitch, rowBytes);
+
+		if(SDL_MUSTLOCK(src))
+			SDL_UnlockSurface(src);
+		if(SDL_MUSTLOCK(dst))
+			SDL_UnlockSurface(dst);
+	}
+
 	map <string,SDL_Surface*>* images; // a map of the game's images, mapping the actual SDL_Surface* to a string name
+	TransformCache* transforms; // rotated/scaled variants of the images above
+	map <string,RLESprite*>* rleImages; // run length encoded copies of the mostly transparent images above
+	map <string,CollisionMask*>* masks; // pixel collision masks of the images above
+	AsyncLoader* loader; // decodes images requested with requestImage in the background
+	vector< pair<string,SDL_Surface*> > decoded; // images handed back by the loader, reused every frame
+	AssetWatcher* watcher; // NULL unless hot reloading
+	vector<string> changedFiles; // reused every frame
+	set<string> reloading; // changed files being decoded again
+	set<string> failed; // images that couldn't be loaded
+	vector< pair<string,SDL_Surface*> > reloads; // decoded again, waiting for applyReloads
+	int numReloads;
+	bool useRLE;
+	int rleThreshold; // in percent
+	bool generateMasks;
 
 };
 	// END OF: SPRITE MANAGER -----------------------------------
@@ -0,0 +1,304 @@
+/*SurfaceUtils.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* A handful of static helpers for working with SDL_Surfaces at the pixel level: reading and writing
+* single pixels regardless of bit depth, creating blank surfaces that match the screen and carry the
+* engine's transparent color key (255,0,255), and measuring how much memory a surface occupies.
+*
+* Also home to releaseSurface (and releaseObject), which engine code uses instead of SDL_FreeSurface (or
+* delete) for things that might still be in a recorded frame. Normally they're freed right away; while
+* pipelined rendering is running they're held until the main thread has drawn every frame that could
+* reference them.
+*/
+
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include "SDL.h"
+
+#ifndef SURFACEUTILS_H
+#define SURFACEUTILS_H
+
+// the engine wide transparent color, SpriteManager keys every image it loads with this color
+#define COLORKEY_R 0xFF
+#define COLORKEY_G 0x00
+#define COLORKEY_B 0xFF
+
+//------------------------------- CLASS: SURFACE UTILS ----------------------------------
+class SurfaceUtils
+{
+
+public:
+	// returns the raw pixel value at (x,y); the surface should be locked beforehand if SDL_MUSTLOCK says so
+	static Uint32 getPixel(SDL_Surface* s, int x, int y)
+	{
+		int bpp = s->format->BytesPerPixel;
+		Uint8* p = (Uint8*)s->pixels + y * s->pitch + x * bpp;
+
+		switch(bpp)
+		{
+			case 1:
+				return *p;
+			case 2:
+				return *(Uint16*)p;
+			case 3:
+				if(SDL_BYTEORDER == SDL_BIG_ENDIAN)
+					return p[0] << 16 | p[1] << 8 | p[2];
+				else
+					return p[0] | p[1] << 8 | p[2] << 16;
+			case 4:
+				return *(Uint32*)p;
+		}
+
+		return 0;
+	}
+
+	// writes the raw pixel value at (x,y); same locking rules as getPixel
+	static void putPixel(SDL_Surface* s, int x, int y, Uint32 pixel)
+	{
+		int bpp = s->format->BytesPerPixel;
+		Uint8* p = (Uint8*)s->pixels + y * s->pitch + x * bpp;
+
+		switch(bpp)
+		{
+			case 1:
+				*p = (Uint8)pixel;
+				break;
+			case 2:
+				*(Uint16*)p = (Uint16)pixel;
+				break;
+			case 3:
+				if(SDL_BYTEORDER == SDL_BIG_ENDIAN)
+				{
+					p[0] = (pixel >> 16) & 0xFF;
+					p[1] = (pixel >> 8) & 0xFF;
+					p[2] = pixel & 0xFF;
+				}
+				else
+				{
+					p[0] = pixel & 0xFF;
+					p[1] = (pixel >> 8) & 0xFF;
+					p[2] = (pixel >> 16) & 0xFF;
+				}
+				break;
+			case 4:
+				*(Uint32*)p = pixel;
+				break;
+		}
+	}
+
+	// the color key as it is represented in the given format
+	static Uint32 mapColorKey(SDL_PixelFormat* format)
+	{
+		return SDL_MapRGB(format, COLORKEY_R, COLORKEY_G, COLORKEY_B);
+	}
+
+	// number of bytes the pixel data of a surface takes up (0 for NULL)
+	static int surfaceBytes(SDL_Surface* s)
+	{
+		if(s == NULL)
+			return 0;
+
+		return s->pitch * s->h;
+	}
+
+	// creates a w x h software surface in the same format as the screen (or 32 bit if there is no screen yet),
+	// filled entirely with the color key and keyed, so anything blitted onto it keeps its transparency
+	static SDL_Surface* createKeyedSurface(int w, int h)
+	{
+		SDL_Surface* screen = SDL_GetVideoSurface();
+
+		if(screen != NULL)
+			return createKeyedSurface(w, h, screen->format);
+
+		return createKeyedSurface(w, h, NULL);
+	}
+
+	// same as above, but in the given pixel format (32 bit if format is NULL)
+	static SDL_Surface* createKeyedSurface(int w, int h, SDL_PixelFormat* f)
+	{
+		SDL_Surface* s = NULL;
+
+		if(w < 1)
+			w = 1;
+		if(h < 1)
+			h = 1;
+
+		if(f != NULL)
+			s = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, f->BitsPerPixel, f->Rmask, f->Gmask, f->Bmask, f->Amask);
+		else
+			s = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+
+		if(s == NULL)
+			return NULL;
+
+		if(f != NULL && f->palette != NULL && s->format->palette != NULL)
+			SDL_SetColors(s, f->palette->colors, 0, f->palette->ncolors);
+
+		Uint32 colorkey = mapColorKey(s->format);
+		SDL_FillRect(s, NULL, colorkey);
+		SDL_SetColorKey(s, SDL_SRCCOLORKEY, colorkey);
+
+		return s;
+	}
+
+	// copies the pixels of src (the clip part of it, or all of it if clip is NULL) that aren't its color key
+	// onto dst at (x,y), like a colorkey blit but without SDL_BlitSurface, which changes the source surface
+	// and so can't be used on a surface the main thread might be drawing (pipelined rendering)
+	static void copyKeyed(SDL_Surface* src, SDL_Rect* clip, SDL_Surface* dst, int x, int y)
+	{
+		int sx = 0, sy = 0, w = src->w, h = src->h;
+		if(clip != NULL)
+		{
+			sx = clip->x;
+			sy = clip->y;
+			w = clip->w;
+			h = clip->h;
+		}
+
+		Uint32 key = (src->flags & SDL_SRCCOLORKEY) ? src->format->colorkey : mapColorKey(src->format);
+		bool sameFormat = src->format->BytesPerPixel == dst->format->BytesPerPixel && src->format->Rmask == dst->format->Rmask &&
+			src->format->Gmask == dst->format->Gmask && src->format->Bmask == dst->format->Bmask && src->format->BytesPerPixel > 1;
+
+		if(SDL_MUSTLOCK(src))
+			SDL_LockSurface(src);
+		if(SDL_MUSTLOCK(dst))
+			SDL_LockSurface(dst);
+
+		for(int j = 0; j < h; j++)
+		{
+			int u = sy + j, v = y + j;
+			if(u < 0 || u >= src->h || v < 0 || v >= dst->h)
+				continue;
+
+			for(int i = 0; i < w; i++)
+			{
+				int s = sx + i, d = x + i;
+				if(s < 0 || s >= src->w || d < 0 || d >= dst->w)
+					continue;
+
+				Uint32 pixel = getPixel(src, s, u);
+				if(pixel == key)
+					continue;
+
+				if(!sameFormat)
+				{
+					Uint8 r, g, b;
+					SDL_GetRGB(pixel, src->format, &r, &g, &b);
+					pixel = SDL_MapRGB(dst->format, r, g, b);
+				}
+
+				putPixel(dst, d, v, pixel);
+			}
+		}
+
+		if(SDL_MUSTLOCK(dst))
+			SDL_UnlockSurface(dst);
+		if(SDL_MUSTLOCK(src))
+			SDL_UnlockSurface(src);
+	}
+
+	// frees a surface, or if releases are being deferred, queues it to be freed once the frame currently
+	// being prepared has been drawn
+	static void releaseSurface(SDL_Surface* s)
+	{
+		if(s == NULL)
+			return;
+
+		release(s, freeSurface);
+	}
+
+	// same as releaseSurface for other things a recorded frame can point to (e.g. RLE sprites), which are deleted
+	template <class T> static void releaseObject(T* p)
+	{
+		if(p != NULL)
+			release(p, deleteObject<T>);
+	}
+
+	// turns deferred releasing on or off; turning it off frees anything still waiting
+	// only to be called from the game (simulation) thread, like releaseSurface itself
+	static void deferReleases(bool on)
+	{
+		DeferredReleases& d = deferred();
+		d.active = on;
+
+		if(!on)
+		{
+			for(unsigned int i = 0; i < d.pending.size(); i++)
+				d.pending[i].destroy(d.pending[i].p);
+			d.pending.clear();
+		}
+	}
+
+	// sets the number of the frame being prepared; surfaces released from now on may be referenced by it
+	static void setReleaseFence(Uint32 frame)
+	{
+		deferred().fence = frame;
+	}
+
+	// frees everything queued whose frame has been drawn, given how many frames have been drawn in total
+	static void collectReleases(Uint32 framesDrawn)
+	{
+		DeferredReleases& d = deferred();
+
+		unsigned int kept = 0;
+		for(unsigned int i = 0; i < d.pending.size(); i++)
+		{
+			if(d.pending[i].frame < framesDrawn)
+				d.pending[i].destroy(d.pending[i].p);
+			else
+				d.pending[kept++] = d.pending[i];
+		}
+		d.pending.resize(kept);
+	}
+
+private:
+	struct PendingRelease
+	{
+		void* p;
+		void (*destroy)(void*);
+		Uint32 frame; // the fence when it was released
+	};
+
+	struct DeferredReleases
+	{
+		bool active;
+		Uint32 fence; // frame number released things get tagged with
+		std::vector<PendingRelease> pending;
+	};
+
+	static DeferredReleases& deferred()
+	{
+		static DeferredReleases d = {false, 0, std::vector<PendingRelease>()};
+		return d;
+	}
+
+	static void release(void* p, void (*destroy)(void*))
+	{
+		DeferredReleases& d = deferred();
+		if(!d.active)
+		{
+			destroy(p);
+			return;
+		}
+
+		PendingRelease r = {p, destroy, d.fence};
+		d.pending.push_back(r);
+	}
+
+	static void freeSurface(void* p)
+	{
+		SDL_FreeSurface((SDL_Surface*)p);
+	}
+
+	template <class T> static void deleteObject(void* p)
+	{
+		delete (T*)p;
+	}
+
+};
+	// END OF: SURFACE UTILS -----------------------------------
+#endif
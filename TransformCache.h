@@ -0,0 +1,286 @@
+/*TransformCache.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* SDL 1.2 can only blit, it can't rotate or scale, so rotated/scaled versions of a sprite ("variants")
+* have to be generated by hand. Doing that every frame is far too slow, so this cache generates each
+* variant once and hands the same surface back after that.
+*
+* Angles and scales are quantized (by default to 64 angles per full turn and scale steps of 1/16), so
+* sprites spinning smoothly end up sharing a small, fixed set of variants. Variants are generated with a
+* nearest neighbour resampler in 16.16 fixed point, which never blends pixels, so the color key is kept
+* exactly and transparency works the same as on the original sprite.
+*
+* The cache is bounded by a memory budget; when it's exceeded the least recently used variants are freed.
+*/
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <string>
+#include <cmath>
+
+#include "SDL.h"
+#include "SurfaceUtils.h"
+#include "MemoryTracker.h"
+
+#ifndef TRANSFORMCACHE_H
+#define TRANSFORMCACHE_H
+
+#define DEFAULT_ANGLE_STEPS 64 // number of distinct angles in a full turn
+#define SCALE_STEPS 16 // scale is quantized to 1/SCALE_STEPS
+#define DEFAULT_TRANSFORM_BUDGET (8 * 1024 * 1024) // bytes of variants kept around by default
+
+//------------------------------- CLASS: TRANSFORM CACHE ----------------------------------
+class TransformCache
+{
+
+public:
+	int getBytesUsed()						{return bytesUsed;}
+	int getBudget()							{return budget;}
+	int getAngleSteps()						{return angleSteps;}
+	int getHits()							{return hits;}
+	int getMisses()							{return misses;}
+	int getNumVariants()					{return variants.size();}
+
+	void setBudget(int bytes)				{budget = bytes; trim();}
+
+	TransformCache()
+	{
+		angleSteps = DEFAULT_ANGLE_STEPS;
+		budget = DEFAULT_TRANSFORM_BUDGET;
+		bytesUsed = 0;
+		hits = misses = 0;
+	}
+
+	virtual ~TransformCache()
+	{
+		clear();
+	}
+
+	// changing the number of angle steps makes every existing variant useless, so they are all dropped
+	void setAngleSteps(int steps)
+	{
+		if(steps < 1 || steps == angleSteps)
+			return;
+
+		clear();
+		angleSteps = steps;
+	}
+
+	int quantizeAngle(double angle)
+	{
+		int step = (int)floor(angle * angleSteps / 360.0 + 0.5) % angleSteps;
+		if(step < 0)
+			step += angleSteps;
+
+		return step;
+	}
+
+	static int quantizeScale(double scale)
+	{
+		return (int)floor(scale * SCALE_STEPS + 0.5);
+	}
+
+	// returns src rotated by angle degrees (clockwise on screen) and scaled by scale, generating the variant
+	// if it isn't cached; the untransformed sprite is returned as is, and NULL for a scale that rounds to 0
+	// the returned surface belongs to the cache and is only guaranteed to live until the next call to get
+	SDL_Surface* get(std::string name, SDL_Surface* src, double angle, double scale)
+	{
+		if(src == NULL)
+			return NULL;
+
+		Key key;
+		key.name = name;
+		key.angle = quantizeAngle(angle);
+		key.scale = quantizeScale(scale);
+
+		if(key.scale <= 0)
+			return NULL;
+		if(key.angle == 0 && key.scale == SCALE_STEPS)
+			return src;
+
+		std::map<Key, std::list<Entry>::iterator>::iterator found = index.find(key);
+		if(found != index.end())
+		{
+			hits++;
+			variants.splice(variants.begin(), variants, found->second); // now the most recently used
+			return found->second->surface;
+		}
+
+		misses++;
+
+		SDL_Surface* s = transform(src, key.angle * 360.0 / angleSteps, (double)key.scale / SCALE_STEPS);
+		if(s == NULL)
+			return NULL;
+
+		Entry e;
+		e.key = key;
+		e.surface = s;
+		variants.push_front(e);
+		index[key] = variants.begin();
+		bytesUsed += SurfaceUtils::surfaceBytes(s);
+		MEM_TRACK(MEM_SURFACES, SurfaceUtils::surfaceBytes(s));
+
+		trim(1); // keep at least the variant we are about to hand back
+
+		return s;
+	}
+
+	// generates every angle variant of src at the given scale ahead of time, so there are no hitches
+	// when the sprite first starts spinning; stops early if the budget would be exceeded
+	void prewarm(std::string name, SDL_Surface* src, double scale)
+	{
+		for(int i = 0; i < angleSteps; i++)
+		{
+			get(name, src, i * 360.0 / angleSteps, scale);
+			if(bytesUsed >= budget)
+				break;
+		}
+	}
+
+	// frees every variant of one sprite, e.g. when the sprite itself is replaced or unloaded
+	void invalidate(std::string name)
+	{
+		std::list<Entry>::iterator it = variants.begin();
+		while(it != variants.end())
+		{
+			if(it->key.name == name)
+			{
+				freeEntry(*it);
+				index.erase(it->key);
+				it = variants.erase(it);
+			}
+			else
+				it++;
+		}
+	}
+
+	void clear()
+	{
+		for(std::list<Entry>::iterator it = variants.begin(); it != variants.end(); it++)
+			freeEntry(*it);
+
+		variants.clear();
+		index.clear();
+	}
+
+	// builds a new surface holding src rotated and scaled (no quantizing or caching), centered in a surface
+	// just large enough to hold it; anything outside the sprite is filled with the source's color key
+	static SDL_Surface* transform(SDL_Surface* src, double angle, double scale)
+	{
+		double rad = angle * 3.14159265358979323846 / 180.0;
+		double c = cos(rad), s = sin(rad);
+
+		// the small epsilon keeps right angles from growing a pixel due to cos(90) not being exactly 0
+		int dw = (int)ceil(fabs(src->w * c * scale) + fabs(src->h * s * scale) - 0.0001);
+		int dh = (int)ceil(fabs(src->w * s * scale) + fabs(src->h * c * scale) - 0.0001);
+
+		SDL_Surface* dst = SurfaceUtils::createKeyedSurface(dw, dh, src->format);
+		if(dst == NULL)
+			return NULL;
+
+		Uint32 key = (src->flags & SDL_SRCCOLORKEY) ? src->format->colorkey : SurfaceUtils::mapColorKey(src->format);
+		SDL_FillRect(dst, NULL, key);
+		SDL_SetColorKey(dst, SDL_SRCCOLORKEY, key);
+
+		// inverse mapping: step through destination pixels and work out which source pixel lands there
+		// all in 16.16 fixed point, so the inner loop is just adds, shifts and a bounds check
+		Sint32 duDx = (Sint32)(c / scale * 65536.0);
+		Sint32 dvDx = (Sint32)(-s / scale * 65536.0);
+		Sint32 duDy = (Sint32)(s / scale * 65536.0);
+		Sint32 dvDy = (Sint32)(c / scale * 65536.0);
+
+		// sample at pixel centers, relative to the centers of both surfaces
+		double cx = dw / 2.0 - 0.5, cy = dh / 2.0 - 0.5;
+		Sint32 uStart = (Sint32)((src->w / 2.0 + (-cx * c - cy * s) / scale) * 65536.0);
+		Sint32 vStart = (Sint32)((src->h / 2.0 + (cx * s - cy * c) / scale) * 65536.0);
+
+		Sint32 uMax = src->w << 16;
+		Sint32 vMax = src->h << 16;
+
+		if(SDL_MUSTLOCK(src))
+			SDL_LockSurface(src);
+		if(SDL_MUSTLOCK(dst))
+			SDL_LockSurface(dst);
+
+		bool fast = src->format->BytesPerPixel == 4;
+
+		for(int y = 0; y < dh; y++)
+		{
+			Sint32 u = uStart + y * duDy;
+			Sint32 v = vStart + y * dvDy;
+			Uint32* row = (Uint32*)((Uint8*)dst->pixels + y * dst->pitch);
+
+			for(int x = 0; x < dw; x++, u += duDx, v += dvDx)
+			{
+				if(u < 0 || v < 0 || u >= uMax || v >= vMax)
+					continue; // already the color key
+
+				if(fast)
+					row[x] = *(Uint32*)((Uint8*)src->pixels + (v >> 16) * src->pitch + (u >> 16) * 4);
+				else
+					SurfaceUtils::putPixel(dst, x, y, SurfaceUtils::getPixel(src, u >> 16, v >> 16));
+			}
+		}
+
+		if(SDL_MUSTLOCK(dst))
+			SDL_UnlockSurface(dst);
+		if(SDL_MUSTLOCK(src))
+			SDL_UnlockSurface(src);
+
+		return dst;
+	}
+
+protected:
+	struct Key
+	{
+		std::string name;
+		int angle; // quantized angle step
+		int scale; // scale in 1/SCALE_STEPS
+
+		bool operator<(const Key& k) const
+		{
+			if(angle != k.angle)
+				return angle < k.angle;
+			if(scale != k.scale)
+				return scale < k.scale;
+			return name < k.name;
+		}
+	};
+
+	struct Entry
+	{
+		Key key;
+		SDL_Surface* surface;
+	};
+
+	int angleSteps;
+	int budget, bytesUsed; // in bytes
+	int hits, misses;
+
+	std::list<Entry> variants; // most recently used first
+	std::map<Key, std::list<Entry>::iterator> index;
+
+	void freeEntry(Entry& e)
+	{
+		bytesUsed -= SurfaceUtils::surfaceBytes(e.surface);
+		MEM_UNTRACK(MEM_SURFACES, SurfaceUtils::surfaceBytes(e.surface));
+		SurfaceUtils::releaseSurface(e.surface);
+	}
+
+	// frees least recently used variants until within budget, never going below keep variants
+	void trim(unsigned int keep = 0)
+	{
+		while(bytesUsed > budget && variants.size() > keep)
+		{
+			freeEntry(variants.back());
+			index.erase(variants.back().key);
+			variants.pop_back();
+		}
+	}
+
+};
+	// END OF: TRANSFORM CACHE -----------------------------------
+#endif
@@ -0,0 +1,265 @@
+/*UpdateScheduler.h
+* Joshua Speight, 2011
+* Liquid Pro Quo
+*
+* Decides which objects get updated each frame, so big levels don't pay for every object every frame.
+* Objects ask for a tick bucket (every frame, every 2nd or every 8th) and are spread evenly over the
+* frames of their bucket. Objects far from the focus point (normally the player) get moved to a slower
+* bucket. Sleeping objects aren't in any list at all and cost nothing until something wakes them.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdlib>
+
+#include "GameObj.h"
+
+#ifndef UPDATESCHEDULER_H
+#define UPDATESCHEDULER_H
+
+#define MAX_TICK_RATE 8 // frames between updates in the slowest bucket
+
+//------------------------------- CLASS: UPDATE SCHEDULER ----------------------------------
+class UpdateScheduler
+{
+
+public:
+	UpdateScheduler()
+	{
+		frame = 0;
+		ticking = false;
+		current = 0;
+		numScheduled = 0;
+		numAsleep = 0;
+		numUpdated = 0;
+		numSkipped = 0;
+		nearDist = 0;
+		farDist = 0;
+		focusX = 0;
+		focusY = 0;
+	}
+
+	virtual ~UpdateScheduler() {}
+
+	// frames between updates for a bucket
+	static int rateOf(int bucket)
+	{
+		if(bucket == TICK_EVERY_2ND)
+			return 2;
+		if(bucket == TICK_EVERY_8TH)
+			return MAX_TICK_RATE;
+
+		return 1;
+	}
+
+	// starts scheduling an object (asleep objects are remembered but not put in a list)
+	void add(GameObj* o)
+	{
+		if(o == NULL || o->scheduled)
+			return;
+
+		o->scheduled = true;
+		o->lastTick = frame;
+		numScheduled++;
+
+		if(o->asleep)
+			numAsleep++;
+		else
+			insert(o, o->tickBucket);
+	}
+
+	// stops scheduling an object; safe to call from inside an update
+	void remove(GameObj* o)
+	{
+		if(o == NULL || !o->scheduled)
+			return;
+
+		if(o->asleep)
+			numAsleep--;
+		else
+			unlink(o);
+
+		o->scheduled = false;
+		numScheduled--;
+
+		// it may be deleted before its turn comes this frame
+		if(ticking)
+			for(unsigned int i = current; i < due.size(); i++)
+				if(due[i] == o)
+					due[i] = NULL;
+	}
+
+	void sleep(GameObj* o)
+	{
+		if(o->asleep)
+			return;
+
+		o->asleep = true;
+
+		if(o->scheduled)
+		{
+			unlink(o);
+			numAsleep++;
+		}
+	}
+
+	void wake(GameObj* o)
+	{
+		if(!o->asleep)
+			return;
+
+		o->asleep = false;
+
+		if(o->scheduled)
+		{
+			numAsleep--;
+			o->lastTick = frame - 1; // time spent asleep doesn't count toward its next update
+			insert(o, o->tickBucket);
+		}
+	}
+
+	void setBucket(GameObj* o, int bucket)
+	{
+		if(bucket < 0 || bucket >= NUM_TICK_BUCKETS)
+			return;
+
+		o->tickBucket = bucket;
+
+		if(o->scheduled && !o->asleep && o->schedBucket != lodBucket(o))
+		{
+			unlink(o);
+			insert(o, lodBucket(o));
+		}
+	}
+
+	// objects further than nearDist from the focus are updated at most every 2nd frame,
+	// further than farDist at most every 8th; farDist <= 0 turns this off
+	void setLOD(int nearDist, int farDist)
+	{
+		this->nearDist = nearDist;
+		this->farDist = farDist;
+	}
+
+	void setFocus(int x, int y)
+	{
+		focusX = x;
+		focusY = y;
+	}
+
+	// updates everything due this frame
+	void tick(GameManager* gm)
+	{
+		frame++;
+		numUpdated = 0;
+
+		due.clear();
+		for(int b = 0; b < NUM_TICK_BUCKETS; b++)
+		{
+			std::vector<GameObj*>& list = phases[b][frame % rateOf(b)];
+			due.insert(due.end(), list.begin(), list.end());
+		}
+
+		// objects can sleep, wake, move buckets or be removed while this runs, so work off the copy
+		ticking = true;
+		for(current = 0; current < due.size(); current++)
+		{
+			GameObj* o = due[current];
+			if(o == NULL || o->asleep || !o->scheduled)
+				continue;
+
+			int elapsed = (int)(frame - o->lastTick);
+			o->tickScale = elapsed < 1 ? 1 : (elapsed > MAX_TICK_RATE ? MAX_TICK_RATE : elapsed);
+			o->lastTick = frame;
+
+			o->update(gm);
+			numUpdated++;
+
+			// it may have moved, or gone to sleep or away during its update
+			if(due[current] != NULL && o->scheduled && !o->asleep && o->schedBucket != lodBucket(o))
+			{
+				unlink(o);
+				insert(o, lodBucket(o));
+			}
+		}
+		ticking = false;
+		current = 0;
+
+		numSkipped = numScheduled - numUpdated;
+	}
+
+	// stats for the last tick
+	int getNumUpdated()			{return numUpdated;}
+	int getNumSkipped()			{return numSkipped;} // scheduled objects that weren't updated (asleep or not their frame)
+	int getNumAsleep()			{return numAsleep;}
+	int getNumScheduled()		{return numScheduled;}
+
+	// how many awake objects are in a bucket right now (after distance demotion)
+	int getBucketSize(int bucket)
+	{
+		int n = 0;
+		for(int p = 0; p < rateOf(bucket); p++)
+			n += phases[bucket][p].size();
+
+		return n;
+	}
+
+protected:
+	std::vector<GameObj*> phases[NUM_TICK_BUCKETS][MAX_TICK_RATE]; // awake objects by bucket and frame
+	std::vector<GameObj*> due; // objects being updated this tick
+	unsigned int current; // where the tick is in due
+	bool ticking;
+	Uint32 frame;
+
+	int numScheduled, numAsleep, numUpdated, numSkipped;
+
+	int nearDist, farDist;
+	int focusX, focusY;
+
+	// the bucket an object should be in: what it asked for, or slower if it's far away
+	int lodBucket(GameObj* o)
+	{
+		if(farDist <= 0)
+			return o->tickBucket;
+
+		long dx = labs((long)o->getX() - focusX);
+		long dy = labs((long)o->getY() - focusY);
+		long d = dx > dy ? dx : dy; // chebyshev is close enough and has no overflow worries
+
+		int b = TICK_EVERY_FRAME;
+		if(d > farDist)
+			b = TICK_EVERY_8TH;
+		else if(d > nearDist)
+			b = TICK_EVERY_2ND;
+
+		return b > o->tickBucket ? b : o->tickBucket;
+	}
+
+	// puts an awake object in the least crowded frame of a bucket
+	void insert(GameObj* o, int bucket)
+	{
+		int best = 0;
+		for(int p = 1; p < rateOf(bucket); p++)
+			if(phases[bucket][p].size() < phases[bucket][best].size())
+				best = p;
+
+		o->schedBucket = bucket;
+		o->schedPhase = best;
+		o->schedSlot = phases[bucket][best].size();
+		phases[bucket][best].push_back(o);
+	}
+
+	// takes an object out of its list by swapping the last one into its place
+	void unlink(GameObj* o)
+	{
+		std::vector<GameObj*>& list = phases[o->schedBucket][o->schedPhase];
+
+		GameObj* last = list.back();
+		list[o->schedSlot] = last;
+		last->schedSlot = o->schedSlot;
+		list.pop_back();
+	}
+
+};
+	// END OF: UPDATE SCHEDULER -----------------------------------
+#endif